@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+namespace casadi_mpc_template
+{
+
+// Number of global operator new calls of the calling thread so far. Defined in src/allocation_counter.cpp together
+// with the replacement of the global operator new/delete; it is linked into nmpc_planner only, not into the library,
+// so other users of the library keep their allocator.
+uint64_t allocation_count();
+
+} // namespace casadi_mpc_template
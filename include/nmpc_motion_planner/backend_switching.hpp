@@ -0,0 +1,110 @@
+#pragma once
+#include <nmpc_motion_planner/solve_statistics.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace casadi_mpc_template
+{
+
+// Chooses between solver configurations ("levels") ordered from the cheapest (e.g. RTI-SQP, short horizon) to the most
+// accurate (e.g. IPOPT to convergence, long horizon) from the rolling solve times of the active level:
+//  - a level whose p95 solve time exceeds downgrade_load * deadline, or that missed the deadline max_misses times in
+//    the window, is replaced by the next cheaper one right away
+//  - after a full window with p95 below upgrade_load * deadline and at least dwell ticks at the level, the next more
+//    accurate one is tried
+// The gap between the two loads and the dwell time are the hysteresis. An upgrade that is undone within one window
+// doubles the dwell before the next attempt (up to max_dwell), a level that holds for a window resets it.
+class BackendSwitchingPolicy
+{
+  public:
+    struct Config
+    {
+        double deadline = 0.01; // control period [s]
+        double downgrade_load = 0.8;
+        double upgrade_load = 0.4;
+        size_t max_misses = 3;
+        size_t window = 100;
+        size_t dwell = 500;
+        size_t max_dwell = 20000;
+    };
+
+    BackendSwitchingPolicy(size_t num_levels, size_t initial_level, Config config)
+        : num_levels_(std::max<size_t>(num_levels, 1)), level_(std::min(initial_level, num_levels_ - 1)),
+          config_(config), dwell_(config.dwell), stats_(config.window), missed_(std::max<size_t>(config.window, 1), 0)
+    {
+    }
+
+    // adds a solve of the active level, returns the level to use from the next tick on
+    size_t update(double solve_time, int iterations)
+    {
+        stats_.add(solve_time, iterations);
+        // misses in the last window ticks, the flag of the tick that leaves the window is dropped
+        char &missed = missed_[ticks_ % missed_.size()];
+        misses_ -= missed;
+        missed = solve_time > config_.deadline;
+        misses_ += missed;
+        ticks_++;
+        const bool full = stats_.size() >= config_.window;
+        const double p95 = stats_.time_quantile(0.95);
+
+        if (level_ > 0 && (misses_ >= config_.max_misses || (full && p95 > config_.downgrade_load * config_.deadline)))
+        {
+            if (upgraded_ && ticks_ <= config_.window)
+            {
+                dwell_ = std::min(2 * dwell_, config_.max_dwell);
+            }
+            switch_to(level_ - 1, false);
+        }
+        else if (full && ticks_ >= config_.window && upgraded_)
+        {
+            // the upgrade held for a window
+            upgraded_ = false;
+            dwell_ = config_.dwell;
+        }
+        else if (level_ + 1 < num_levels_ && full && ticks_ >= dwell_ && p95 < config_.upgrade_load * config_.deadline)
+        {
+            switch_to(level_ + 1, true);
+        }
+        return level_;
+    }
+
+    size_t level() const
+    {
+        return level_;
+    }
+    size_t switches() const
+    {
+        return switches_;
+    }
+    // solve statistics of the active level since the last switch
+    const SolveStatistics &statistics() const
+    {
+        return stats_;
+    }
+
+  private:
+    void switch_to(size_t level, bool upgrade)
+    {
+        level_ = level;
+        upgraded_ = upgrade;
+        switches_++;
+        ticks_ = 0;
+        misses_ = 0;
+        std::fill(missed_.begin(), missed_.end(), 0);
+        stats_.clear();
+    }
+
+    const size_t num_levels_;
+    size_t level_;
+    const Config config_;
+    size_t dwell_;
+    SolveStatistics stats_;
+    size_t ticks_ = 0;
+    std::vector<char> missed_; // ring of the last window ticks, 1 for a deadline miss
+    size_t misses_ = 0;
+    size_t switches_ = 0;
+    bool upgraded_ = false;
+};
+
+} // namespace casadi_mpc_template
@@ -1,7 +1,13 @@
 #pragma once
 #include <Eigen/Dense>
+#include <algorithm>
 #include <casadi/casadi.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <memory>
+#include <tuple>
+#include <nmpc_motion_planner/failure_point.hpp>
 #include <vector>
 
 namespace casadi_mpc_template
@@ -29,6 +35,64 @@ template <class T> static T integrate_dynamics_rk4(double dt, T x, T u, std::fun
     return x + dt / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
 }
 
+// Kreisselmeier-Steinhauser aggregate of g <= 0: a smooth upper bound of max(g) that is at most log(n) / rho above it,
+// so ks_aggregate(g, rho) <= 0 is a conservative single constraint. The shift by max(g) keeps exp() from overflowing
+// and cancels in the value and the derivatives.
+template <class T> static T ks_aggregate(T g, double rho)
+{
+    T g_max = mmax(g);
+    return g_max + log(sum1(exp(rho * (g - g_max)))) / rho;
+}
+
+// Basis of a clamped uniform B-spline with num_ctrl control points evaluated at num_samples equidistant points of
+// [0, 1]: U = basis * C. Rows are non-negative and sum to one, the first/last sample equals the first/last point.
+static Eigen::MatrixXd bspline_basis(size_t num_ctrl, size_t degree, size_t num_samples)
+{
+    degree = std::min(degree, num_ctrl - 1);
+    const size_t num_knots = num_ctrl + degree + 1;
+    const size_t num_spans = num_ctrl - degree;
+
+    std::vector<double> knots(num_knots);
+    for (size_t i = 0; i < num_knots; i++)
+    {
+        knots[i] = std::min(std::max(double(i) - degree, 0.0), double(num_spans)) / num_spans;
+    }
+
+    Eigen::MatrixXd basis = Eigen::MatrixXd::Zero(num_samples, num_ctrl);
+    for (size_t s = 0; s < num_samples; s++)
+    {
+        double t = num_samples > 1 ? double(s) / (num_samples - 1) : 0.0;
+        if (s + 1 == num_samples && num_samples > 1)
+        {
+            basis(s, num_ctrl - 1) = 1.0;
+            continue;
+        }
+
+        // Cox-de Boor recursion
+        std::vector<double> b(num_knots - 1, 0.0);
+        for (size_t i = 0; i + 1 < num_knots; i++)
+        {
+            b[i] = (knots[i] <= t && t < knots[i + 1]) ? 1.0 : 0.0;
+        }
+        for (size_t p = 1; p <= degree; p++)
+        {
+            for (size_t i = 0; i + p + 1 < num_knots; i++)
+            {
+                double left = knots[i + p] > knots[i] ? (t - knots[i]) / (knots[i + p] - knots[i]) * b[i] : 0.0;
+                double right = knots[i + p + 1] > knots[i + 1]
+                                   ? (knots[i + p + 1] - t) / (knots[i + p + 1] - knots[i + 1]) * b[i + 1]
+                                   : 0.0;
+                b[i] = left + right;
+            }
+        }
+        for (size_t i = 0; i < num_ctrl; i++)
+        {
+            basis(s, i) = b[i];
+        }
+    }
+    return basis;
+}
+
 class Problem
 {
   public:
@@ -58,10 +122,41 @@ class Problem
         Eigen::VectorXd xub = Eigen::VectorXd::Constant(nx(), inf);
         Eigen::VectorXd xlb = -xub;
         x_bounds_ = std::vector<LUbound>{horizon(), {xlb, xub}};
+
+        p_ = casadi::MX::sym("p", 0, 1);
     }
 
     virtual casadi::MX dynamics(casadi::MX x, casadi::MX u) = 0;
 
+    // discrete time transition x_{k+1} = f(x_k, u_k) according to dynamics_type()
+    std::function<casadi::MX(casadi::MX, casadi::MX)> discrete_dynamics()
+    {
+        std::function<casadi::MX(casadi::MX, casadi::MX)> con_dyn =
+            std::bind(&Problem::dynamics, this, std::placeholders::_1, std::placeholders::_2);
+        switch (dynamics_type())
+        {
+        case DynamicsType::ContinuesForwardEuler:
+            return std::bind(integrate_dynamics_forward_euler<casadi::MX>, dt(), std::placeholders::_1,
+                             std::placeholders::_2, con_dyn);
+        case DynamicsType::ContinuesModifiedEuler:
+            return std::bind(integrate_dynamics_modified_euler<casadi::MX>, dt(), std::placeholders::_1,
+                             std::placeholders::_2, con_dyn);
+        case DynamicsType::ContinuesRK4:
+            return std::bind(integrate_dynamics_rk4<casadi::MX>, dt(), std::placeholders::_1, std::placeholders::_2,
+                             con_dyn);
+        case DynamicsType::Discretized:
+        default:
+            return con_dyn;
+        }
+    }
+
+    // Runtime parameters (e.g. target references) that can change between solves without rebuilding the solver.
+    // Costs and constraints refer to them through parameter().
+    void set_parameter_dim(size_t _np)
+    {
+        p_ = casadi::MX::sym("p", _np, 1);
+    }
+
     void set_input_bound(Eigen::VectorXd lb, Eigen::VectorXd ub, int start = -1, int end = -1)
     {
         std::tie(start, end) = index_range(start, end);
@@ -116,6 +211,24 @@ class Problem
         }
     }
 
+    // Parameterize the inputs U_0..U_{N-1} by a clamped B-spline with num_control_points control points instead of one
+    // decision variable per stage (0 switches back). The input bounds are imposed on the control points, which by the
+    // convex hull property bounds the inputs of every stage the control point influences.
+    void set_input_bspline(size_t num_control_points, size_t degree = 3)
+    {
+        input_ctrl_points_ = num_control_points;
+        input_spline_degree_ = degree;
+    }
+
+    // Condensing on the NLP level: only every block_size-th state (and X_N) is a shooting node, the states in between
+    // are expressions of the node and the inputs and their bounds become inequality constraints. 1 is fully sparse
+    // multiple shooting, the horizon is single shooting. This is not QP-level partial condensing: the QP solver sees
+    // the reduced NLP, HPIPM gets no stage structure for it and solves it as one dense stage.
+    void set_condensing_block(size_t block_size)
+    {
+        condensing_block_ = std::max<size_t>(block_size, 1);
+    }
+
     void add_constraint(ConstraintType type, std::function<casadi::MX(casadi::MX, casadi::MX)> constrinat)
     {
         if (type == ConstraintType::Equality)
@@ -128,11 +241,25 @@ class Problem
         }
     }
 
+    // Adds the vector inequality constraint(x, u) <= 0 as the single smooth constraint ks_aggregate(constraint, rho) <= 0.
+    // Larger rho is less conservative but less smooth.
+    void add_aggregated_constraint(std::function<casadi::MX(casadi::MX, casadi::MX)> constrinat, double rho)
+    {
+        inequality_constrinats_.push_back(
+            [constrinat, rho](casadi::MX x, casadi::MX u) { return ks_aggregate(constrinat(x, u), rho); });
+    }
+
     virtual casadi::MX stage_cost(casadi::MX x, casadi::MX u)
     {
         return 0;
     }
 
+    // cost of stage 0..horizon-1, for costs that differ along the horizon (e.g. a time-varying reference)
+    virtual casadi::MX stage_cost(casadi::MX x, casadi::MX u, size_t stage)
+    {
+        return stage_cost(x, u);
+    }
+
     virtual casadi::MX terminal_cost(casadi::MX x)
     {
         return 0;
@@ -158,6 +285,36 @@ class Problem
     {
         return dt_;
     }
+    size_t np() const
+    {
+        return p_.size1();
+    }
+    const std::pair<Eigen::VectorXd, Eigen::VectorXd> &input_bound(size_t i) const
+    {
+        return u_bounds_[i];
+    }
+    const std::pair<Eigen::VectorXd, Eigen::VectorXd> &state_bound(size_t i) const
+    {
+        return x_bounds_[i];
+    }
+    size_t input_control_points() const
+    {
+        return input_ctrl_points_;
+    }
+    size_t input_spline_degree() const
+    {
+        return input_spline_degree_;
+    }
+    size_t condensing_block() const
+    {
+        return condensing_block_;
+    }
+    casadi::MX parameter() const
+    {
+        return p_;
+    }
+
+    using LUbound = std::pair<Eigen::VectorXd, Eigen::VectorXd>;
 
   private:
     std::pair<int, int> index_range(int start, int end)
@@ -183,11 +340,53 @@ class Problem
     std::vector<ConstraintFunc> equality_constrinats_;
     std::vector<ConstraintFunc> inequality_constrinats_;
 
-    using LUbound = std::pair<Eigen::VectorXd, Eigen::VectorXd>;
     std::vector<LUbound> u_bounds_;
     std::vector<LUbound> x_bounds_;
 
+    casadi::MX p_;
+
+    size_t input_ctrl_points_ = 0;
+    size_t input_spline_degree_ = 3;
+    size_t condensing_block_ = 1;
+
     friend class MPC;
+    friend class ScenarioMPC;
+};
+
+// A solution is rejected when the primal or dual solution or the constraint values are not finite, or IPOPT stopped
+// on an invalid number or a failed step. IPOPT then returns its last iterate, which may be finite but is no plan.
+inline bool valid_solution(casadi::DMDict &sol, const casadi::Dict &stats)
+{
+    for (const char *key : {"x", "f", "g", "lam_x", "lam_g"})
+    {
+        const std::vector<double> &v = sol[key].nonzeros();
+        if (!std::all_of(v.begin(), v.end(), [](double x) { return std::isfinite(x); }))
+        {
+            return false;
+        }
+    }
+    auto status = stats.find("return_status");
+    if (status != stats.end() && status->second.is_string())
+    {
+        const std::string &s = status->second.as_string();
+        return s != "Invalid_Number_Detected" && s != "Restoration_Failed" && s != "Error_In_Step_Computation";
+    }
+    return true;
+}
+
+// What MPC::solve does when the measured x0 violates the state bounds (e.g. joint velocities above their limits),
+// which with X_0 pinned to x0 can leave no feasible trajectory:
+//   Pin     - solve as is (previous behaviour)
+//   Project - clamp x0 onto the bounds
+//   Relax   - keep x0 and widen the violated bounds of every stage to the envelope reachable from x0 at full braking
+//   Soft    - keep x0 and solve this tick with all state bounds, also those of condensed states, softened by an L1
+//             penalty
+enum class InitialStatePolicy
+{
+    Pin,
+    Project,
+    Relax,
+    Soft,
 };
 
 class MPC
@@ -195,8 +394,14 @@ class MPC
   public:
     static casadi::Dict default_config()
     {
-        casadi::Dict config = {{"calc_lam_p", true},     {"calc_lam_x", true},  {"ipopt.sb", "yes"},
-                               {"ipopt.print_level", 0}, {"print_time", false}, {"ipopt.warm_start_init_point", "yes"},
+        // check_derivatives_for_naninf stops IPOPT at the first NaN/Inf instead of after its iteration budget
+        casadi::Dict config = {{"calc_lam_p", true},
+                               {"calc_lam_x", true},
+                               {"ipopt.sb", "yes"},
+                               {"ipopt.print_level", 0},
+                               {"print_time", false},
+                               {"ipopt.warm_start_init_point", "yes"},
+                               {"ipopt.check_derivatives_for_naninf", "yes"},
                                {"expand", true}};
         return config;
     }
@@ -211,7 +416,9 @@ class MPC
                                {"print_status", false},
                                {"print_time", false},
                                {"qpsol", "qpoases"},
-                               {"qpsol_options", casadi::Dict{{"enableRegularisation", true}, {"printLevel", "none"}}},
+                               {"qpsol_options", casadi::Dict{{"enableRegularisation", true},
+                                                              {"printLevel", "none"},
+                                                              {"error_on_fail", false}}},
                                {"expand", true}};
         return config;
     }
@@ -231,8 +438,64 @@ class MPC
         return config;
     }
 
+    // OSQP sets up its KKT system once for the fixed QP sparsity, afterwards only values are updated, the symbolic
+    // factorization is reused and primal/dual iterates are warm started
+    static casadi::Dict default_osqp_config()
+    {
+        casadi::Dict config = {{"calc_lam_p", true},
+                               {"calc_lam_x", true},
+                               {"max_iter", 100},
+                               {"print_header", false},
+                               {"print_iteration", false},
+                               {"print_status", false},
+                               {"print_time", false},
+                               {"qpsol", "osqp"},
+                               {"qpsol_options", casadi::Dict{{"warm_start_primal", true},
+                                                              {"warm_start_dual", true},
+                                                              {"error_on_fail", false},
+                                                              {"osqp", casadi::Dict{{"verbose", false},
+                                                                                    {"polish", false},
+                                                                                    {"eps_abs", 1e-5},
+                                                                                    {"eps_rel", 1e-5},
+                                                                                    {"max_iter", 4000}}}}},
+                               {"expand", true}};
+        return config;
+    }
+
+    // real-time iteration: a single SQP step (one QP) per tick on top of a sqpmethod config
+    static casadi::Dict rti_config(casadi::Dict config)
+    {
+        config["max_iter"] = 1;
+        config["error_on_fail"] = false;
+        return config;
+    }
+
+    // sqpmethod with qrqp only uses solvers that CasADi can code generate, see nmpc_codegen
+    static casadi::Dict default_qrqp_config()
+    {
+        casadi::Dict config = {{"calc_lam_p", true},
+                               {"calc_lam_x", true},
+                               {"max_iter", 20},
+                               {"print_header", false},
+                               {"print_iteration", false},
+                               {"print_status", false},
+                               {"print_time", false},
+                               {"qpsol", "qrqp"},
+                               {"qpsol_options", casadi::Dict{{"print_iter", false},
+                                                              {"print_header", false},
+                                                              {"print_info", false},
+                                                              {"error_on_fail", false}}},
+                               {"expand", true}};
+        return config;
+    }
+
+    // With a solver_cache file the solver is deserialized from it instead of being built (expanded, derivatives
+    // generated), and written to it after a build. A hash of the built NLP (its serialized f and g), the solver plugin
+    // and the options is appended to the file name (see solver_cache_file()), so a changed problem code never loads
+    // an old solver. A loaded solver whose input sizes do not match the NLP is rebuilt.
     template <class T>
-    MPC(std::shared_ptr<T> prob, std::string solver_name = "ipopt", casadi::Dict config = default_config())
+    MPC(std::shared_ptr<T> prob, std::string solver_name = "ipopt", casadi::Dict config = default_config(),
+        std::string solver_cache = "")
         : prob_(prob), solver_name_(solver_name), config_(config)
     {
         using namespace casadi;
@@ -245,108 +508,187 @@ class MPC
         Xs.reserve(N + 1);
         Us.reserve(N);
 
-        for (size_t i = 0; i < N; i++)
+        auto &u_bounds = prob_->u_bounds_;
+        auto &x_bounds = prob_->x_bounds_;
+
+        // B-spline input parameterization: Us[i] = sum_j basis(i, j) * Cs[j]
+        const size_t nc = prob_->input_control_points();
+        std::vector<MX> Cs;
+        std::vector<Problem::LUbound> c_bounds;
+        if (nc > 0)
+        {
+            Eigen::MatrixXd basis = bspline_basis(nc, prob_->input_spline_degree(), N);
+            for (size_t j = 0; j < nc; j++)
+            {
+                Cs.push_back(MX::sym("C_" + std::to_string(j), nu, 1));
+
+                // a control point has to satisfy the bounds of every stage it influences
+                Eigen::VectorXd lb = Eigen::VectorXd::Constant(nu, -inf);
+                Eigen::VectorXd ub = Eigen::VectorXd::Constant(nu, inf);
+                for (size_t i = 0; i < N; i++)
+                {
+                    if (basis(i, j) > 0)
+                    {
+                        lb = lb.cwiseMax(u_bounds[i].first);
+                        ub = ub.cwiseMin(u_bounds[i].second);
+                    }
+                }
+                c_bounds.push_back({lb, ub});
+            }
+            for (size_t i = 0; i < N; i++)
+            {
+                MX u = MX::zeros(nu, 1);
+                for (size_t j = 0; j < nc; j++)
+                {
+                    if (basis(i, j) > 0)
+                    {
+                        u += basis(i, j) * Cs[j];
+                    }
+                }
+                Us.push_back(u);
+            }
+        }
+
+        for (size_t i = 0; nc == 0 && i < N; i++)
         {
-            Xs.push_back(MX::sym("X_" + std::to_string(i), nx, 1));
             Us.push_back(MX::sym("U_" + std::to_string(i), nu, 1));
         }
-        Xs.push_back(MX::sym("X_" + std::to_string(N), nx, 1));
 
-        std::vector<MX> w, g;
+        // shooting nodes, the other states are expressions of the previous node and the inputs in between
+        const size_t M = prob_->condensing_block();
+        auto is_node = [&](size_t i) { return i % M == 0 || i == N; };
+        Xs.push_back(MX::sym("X_0", nx, 1));
+
+        std::vector<MX> w;
         std::vector<DM> w0;
         MX J = 0;
 
-        std::function<casadi::MX(casadi::MX, casadi::MX)> dynamics;
-        switch (prob_->dynamics_type())
+        // g is ordered by QP stage (block of M stages between two nodes): the continuity of the next node, then the
+        // bounds of the eliminated states and the path constraints of the block's states, the [A B -I; C D] stage
+        // layout of HPIPM. Constraints on a node state belong to the block that starts at the node.
+        const size_t Nb = (N + M - 1) / M;
+        auto block = [&](size_t i) { return i == N ? Nb : i / M; };
+        struct Rows
         {
-        case Problem::DynamicsType::ContinuesForwardEuler: {
-            std::function<casadi::MX(casadi::MX, casadi::MX)> con_dyn =
-                std::bind(&Problem::dynamics, prob_, std::placeholders::_1, std::placeholders::_2);
-            dynamics = std::bind(integrate_dynamics_forward_euler<casadi::MX>, prob_->dt(), std::placeholders::_1,
-                                 std::placeholders::_2, con_dyn);
-            break;
-        }
-        case Problem::DynamicsType::ContinuesModifiedEuler: {
-            std::function<casadi::MX(casadi::MX, casadi::MX)> con_dyn =
-                std::bind(&Problem::dynamics, prob_, std::placeholders::_1, std::placeholders::_2);
-            dynamics = std::bind(integrate_dynamics_modified_euler<casadi::MX>, prob_->dt(), std::placeholders::_1,
-                                 std::placeholders::_2, con_dyn);
-            break;
-        }
-        case Problem::DynamicsType::ContinuesRK4: {
-            std::function<casadi::MX(casadi::MX, casadi::MX)> con_dyn =
-                std::bind(&Problem::dynamics, prob_, std::placeholders::_1, std::placeholders::_2);
-            dynamics = std::bind(integrate_dynamics_rk4<casadi::MX>, prob_->dt(), std::placeholders::_1,
-                                 std::placeholders::_2, con_dyn);
-            break;
-        }
-        case Problem::DynamicsType::Discretized:
-            dynamics = std::bind(&Problem::dynamics, prob_, std::placeholders::_1, std::placeholders::_2);
-            break;
-        }
+            std::vector<MX> g;
+            std::vector<double> lb, ub;
+            void add(const MX &rows, const Eigen::VectorXd &lower, const Eigen::VectorXd &upper)
+            {
+                g.push_back(rows);
+                lb.insert(lb.end(), lower.data(), lower.data() + lower.size());
+                ub.insert(ub.end(), upper.data(), upper.data() + upper.size());
+            }
+        };
+        std::vector<Rows> dyn_rows(Nb + 1), con_rows(Nb + 1);
+        // (index in x_bound_rows_, block, row in its con_rows) of the eliminated states, resolved once g is assembled
+        std::vector<std::tuple<size_t, size_t, size_t>> eliminated;
+
+        auto dynamics = prob_->discrete_dynamics();
 
-        auto &u_bounds = prob_->u_bounds_;
-        auto &x_bounds = prob_->x_bounds_;
         for (size_t i = 0; i < N; i++) // problem?
         {
-            w.push_back(Xs[i]);
-
-            if (i != 0)
+            if (i == 0)
             {
+                x_offsets_.push_back(lbw_.size());
+                w.push_back(Xs[i]);
                 for (auto l = 0; l < nx; l++)
                 {
-                    lbw_.push_back(x_bounds[i - 1].first[l]);
-                    ubw_.push_back(x_bounds[i - 1].second[l]);
+                    lbw_.push_back(0);
+                    ubw_.push_back(0);
                 }
             }
-            else
+            else if (is_node(i))
             {
+                x_offsets_.push_back(lbw_.size());
+                x_bound_rows_.push_back({false, lbw_.size()});
+                w.push_back(Xs[i]);
                 for (auto l = 0; l < nx; l++)
                 {
-                    lbw_.push_back(0);
-                    ubw_.push_back(0);
+                    lbw_.push_back(x_bounds[i - 1].first[l]);
+                    ubw_.push_back(x_bounds[i - 1].second[l]);
                 }
             }
 
-            w.push_back(Us[i]);
-            for (auto l = 0; l < nu; l++)
+            if (nc == 0)
             {
-                lbw_.push_back(u_bounds[i].first[l]);
-                ubw_.push_back(u_bounds[i].second[l]);
+                u_offsets_.push_back(lbw_.size());
+                w.push_back(Us[i]);
+                for (auto l = 0; l < nu; l++)
+                {
+                    lbw_.push_back(u_bounds[i].first[l]);
+                    ubw_.push_back(u_bounds[i].second[l]);
+                }
+            }
+            else if (i == 0)
+            {
+                // all control points follow X_0, the clamped spline starts at C_0 so U_0 stays at offset nx
+                for (size_t j = 0; j < nc; j++)
+                {
+                    w.push_back(Cs[j]);
+                    for (auto l = 0; l < nu; l++)
+                    {
+                        lbw_.push_back(c_bounds[j].first[l]);
+                        ubw_.push_back(c_bounds[j].second[l]);
+                    }
+                }
             }
             MX xplus = dynamics(Xs[i], Us[i]);
-            J += prob_->stage_cost(Xs[i], Us[i]);
+            J += prob_->stage_cost(Xs[i], Us[i], i);
 
-            g.push_back((xplus - Xs[i + 1]));
-            for (auto l = 0; l < nx; l++)
+            // every stage adds nx rows to g: the continuity condition at a node, the state bounds otherwise
+            Rows &con_block = con_rows[block(i + 1)];
+            if (is_node(i + 1))
+            {
+                Xs.push_back(MX::sym("X_" + std::to_string(i + 1), nx, 1));
+                dyn_rows[block(i)].add(xplus - Xs[i + 1], Eigen::VectorXd::Zero(nx), Eigen::VectorXd::Zero(nx));
+            }
+            else
             {
-                lbg_.push_back(0);
-                ubg_.push_back(0);
+                Xs.push_back(xplus);
+                eliminated.emplace_back(x_bound_rows_.size(), block(i + 1), con_block.lb.size());
+                x_bound_rows_.push_back({true, 0});
+                con_block.add(xplus, x_bounds[i].first, x_bounds[i].second);
             }
 
             for (auto &con : prob_->equality_constrinats_)
             {
                 auto con_val = con(Xs[i + 1], Us[i]);
-                g.push_back(con_val);
-                for (auto l = 0; l < con_val.size1(); l++)
-                {
-                    lbg_.push_back(0);
-                    ubg_.push_back(0);
-                }
+                const casadi_int n = con_val.size1();
+                con_block.add(con_val, Eigen::VectorXd::Zero(n), Eigen::VectorXd::Zero(n));
             }
             for (auto &con : prob_->inequality_constrinats_)
             {
                 auto con_val = con(Xs[i + 1], Us[i]);
-                g.push_back(con_val);
-                for (auto l = 0; l < con_val.size1(); l++)
+                const casadi_int n = con_val.size1();
+                con_block.add(con_val, Eigen::VectorXd::Constant(n, -inf), Eigen::VectorXd::Zero(n));
+            }
+        }
+
+        std::vector<MX> g;
+        std::vector<size_t> con_offsets;
+        for (size_t k = 0; k <= Nb; k++)
+        {
+            for (Rows *rows : {&dyn_rows[k], &con_rows[k]})
+            {
+                if (rows == &con_rows[k])
                 {
-                    lbg_.push_back(-inf);
-                    ubg_.push_back(0);
+                    con_offsets.push_back(lbg_.size());
                 }
+                g.insert(g.end(), rows->g.begin(), rows->g.end());
+                lbg_.insert(lbg_.end(), rows->lb.begin(), rows->lb.end());
+                ubg_.insert(ubg_.end(), rows->ub.begin(), rows->ub.end());
             }
+            g_stages_.push_back({con_offsets.back() - dyn_rows[k].lb.size(), dyn_rows[k].lb.size(),
+                                 con_offsets.back(), con_rows[k].lb.size()});
+        }
+        for (auto &e : eliminated)
+        {
+            x_bound_rows_[std::get<0>(e)].second = con_offsets[std::get<1>(e)] + std::get<2>(e);
         }
         J += prob_->terminal_cost(Xs[N]);
 
+        x_offsets_.push_back(lbw_.size());
+        x_bound_rows_.push_back({false, lbw_.size()});
         w.push_back(Xs[N]);
 
         for (auto l = 0; l < nx; l++)
@@ -356,15 +698,50 @@ class MPC
         }
         // std::cout << "lbw_ size: " << lbw_.size() << std::endl;
         casadi_prob_ = {{"x", vertcat(w)}, {"f", J}, {"g", vertcat(g)}};
-        solver_ = nlpsol("solver", solver_name_, casadi_prob_, config_);
+        if (prob_->np() > 0)
+        {
+            casadi_prob_["p"] = prob_->parameter();
+        }
+        if (nc == 0)
+        {
+            config_ = with_qp_structure(config_);
+        }
+        solver_ = build_solver(solver_cache);
+        inputs_fn_ = Function("inputs", {vertcat(w)}, {horzcat(Us)});
+        states_fn_ = Function("states", {vertcat(w)}, {horzcat(Xs)});
     }
 
-    Eigen::VectorXd solve(Eigen::VectorXd x0)
+    Eigen::VectorXd solve(Eigen::VectorXd x0, Eigen::VectorXd p = Eigen::VectorXd())
     {
         using namespace casadi;
         const size_t nx = prob_->nx();
         const size_t nu = prob_->nu();
         const size_t N = prob_->horizon();
+
+        // a NaN/Inf in x0 or p would end up in the bounds and the warm start, keep the last good plan instead
+        if (static_cast<size_t>(x0.size()) != nx || !x0.allFinite() || static_cast<size_t>(p.size()) != prob_->np() ||
+            !p.allFinite())
+        {
+            record_failure(SolveStatus::InvalidInput, x0, p, casadi::DM());
+            return fallback_input();
+        }
+
+        // x0 against the bounds of X_1 (the first bounded state)
+        violated_.clear();
+        const auto &x_bound = prob_->x_bounds_[0];
+        for (size_t l = 0; l < nx; l++)
+        {
+            if (x0[l] < x_bound.first[l] || x0[l] > x_bound.second[l])
+            {
+                violated_.push_back(l);
+            }
+        }
+        const InitialStatePolicy policy = violated_.empty() ? InitialStatePolicy::Pin : initial_state_policy_;
+        if (policy == InitialStatePolicy::Project)
+        {
+            x0 = x0.cwiseMax(x_bound.first).cwiseMin(x_bound.second);
+        }
+
         // need to fix
         for (auto l = 0; l < nx; l++)
         {
@@ -372,6 +749,18 @@ class MPC
             ubw_[l] = x0[l];
         }
 
+        // the relaxed bounds are restored when solve() returns or the solver throws
+        BoundRestore restore;
+        if (policy == InitialStatePolicy::Relax)
+        {
+            relax_state_bounds(x0, restore);
+        }
+
+        if (shift_warm_start_)
+        {
+            shift_warm_start();
+        }
+
         // std::cout << "lbw_ size: " << lbw_.size() << std::endl;
         // std::cout << "ubw_ size: " << ubw_.size() << std::endl;
         // std::cout << "lbg_ size: " << lbg_.size() << std::endl;
@@ -386,11 +775,29 @@ class MPC
         arg["ubg"] = vertcat(ubg_);
         arg["lam_x0"] = lam_x0_;
         arg["lam_g0"] = lam_g0_;
-        DMDict sol = solver_(arg);
+        if (prob_->np() > 0)
+        {
+            arg["p"] = DM(std::vector<double>(p.data(), p.data() + p.size()));
+        }
+        DMDict sol = policy == InitialStatePolicy::Soft ? solve_soft(arg) : solver_(arg);
+        last_solver_ = policy == InitialStatePolicy::Soft ? soft_solver_ : solver_;
+        restore.apply();
+
+        // the warm start stays at the last good solution
+        const Dict stats = last_solver_.stats();
+        if (!valid_solution(sol, stats))
+        {
+            record_failure(SolveStatus::InvalidSolution, x0, p, sol["x"]);
+            return fallback_input();
+        }
+        last_status_ = stats.at("success").as_bool() ? SolveStatus::Success : SolveStatus::NotConverged;
+        consecutive_failures_ = 0;
 
         w0_ = sol["x"];
         lam_x0_ = sol["lam_x"];
         lam_g0_ = sol["lam_g"];
+        last_good_w_ = w0_;
+        ticks_since_good_ = 0;
 
         Eigen::VectorXd opt_u(nu);
         std::copy(w0_.ptr() + nx, w0_.ptr() + nx + nu, opt_u.data());
@@ -403,7 +810,580 @@ class MPC
         return casadi_prob_;
     }
 
+    // result of the last solve(); for InvalidInput/InvalidSolution solve() returned the input of the last good plan
+    // for the current tick (zero before the first good solve) and failure_point() holds the inputs of the solve
+    SolveStatus status() const
+    {
+        return last_status_;
+    }
+    size_t consecutive_failures() const
+    {
+        return consecutive_failures_;
+    }
+    const FailurePoint &failure_point() const
+    {
+        return failure_;
+    }
+
+    // predicted X_0..X_N of the last solve (also the eliminated states with partial condensing)
+    std::vector<Eigen::VectorXd> state_trajectory() const
+    {
+        return w0_.is_empty() ? std::vector<Eigen::VectorXd>() : columns(states_fn_(w0_)[0]);
+    }
+
+    // predicted U_0..U_{N-1} of the last solve
+    std::vector<Eigen::VectorXd> input_trajectory() const
+    {
+        return w0_.is_empty() ? std::vector<Eigen::VectorXd>() : columns(inputs_fn_(w0_)[0]);
+    }
+
+    // Primal warm start from the plan of another MPC, e.g. when switching solvers or horizons: the states (stage k at
+    // k * dt) and inputs are interpolated at the stages of this problem and held after their end. The multipliers are
+    // reset, they belong to the other problem. With an input B-spline only the states are transferred.
+    void set_warm_start(const std::vector<Eigen::VectorXd> &states, const std::vector<Eigen::VectorXd> &inputs,
+                        double dt)
+    {
+        const size_t nx = prob_->nx();
+        const size_t nu = prob_->nu();
+        const size_t N = prob_->horizon();
+        const size_t M = prob_->condensing_block();
+        if (states.empty() || static_cast<size_t>(states[0].size()) != nx ||
+            (!inputs.empty() && static_cast<size_t>(inputs[0].size()) != nu))
+        {
+            throw std::runtime_error("MPC::set_warm_start: trajectory does not match the problem dimensions");
+        }
+
+        auto sample = [](const std::vector<Eigen::VectorXd> &v, double s) -> Eigen::VectorXd {
+            size_t i = static_cast<size_t>(std::max(s, 0.0));
+            if (i + 1 >= v.size())
+            {
+                return v.back();
+            }
+            s -= i;
+            return (1 - s) * v[i] + s * v[i + 1];
+        };
+
+        std::vector<double> w = w0_.is_empty() ? std::vector<double>(lbw_.size(), 0.0) : w0_.nonzeros();
+        const double scale = prob_->dt() / dt;
+        size_t node = 0;
+        for (size_t i = 0; i <= N; i++)
+        {
+            if (i % M == 0 || i == N)
+            {
+                Eigen::VectorXd x = sample(states, i * scale);
+                std::copy(x.data(), x.data() + nx, w.begin() + x_offsets_[node++]);
+            }
+        }
+        for (size_t i = 0; i < u_offsets_.size() && !inputs.empty(); i++)
+        {
+            Eigen::VectorXd u = sample(inputs, i * scale);
+            std::copy(u.data(), u.data() + nu, w.begin() + u_offsets_[i]);
+        }
+        w0_ = w;
+        lam_x0_ = casadi::DM::zeros(lbw_.size());
+        lam_g0_ = casadi::DM::zeros(lbg_.size());
+    }
+
+    // true if the solver was loaded from the solver_cache file of the constructor
+    bool solver_from_cache() const
+    {
+        return solver_from_cache_;
+    }
+    // the file actually used for the solver_cache of the constructor, empty without a cache
+    const std::string &solver_cache_file() const
+    {
+        return solver_cache_file_;
+    }
+
+    // offsets of the shooting node states and the stage inputs in the decision variables
+    const std::vector<size_t> &state_offsets() const
+    {
+        return x_offsets_;
+    }
+    const std::vector<size_t> &input_offsets() const
+    {
+        return u_offsets_;
+    }
+
+    casadi::Function solver() const
+    {
+        return solver_;
+    }
+
+    // Shift the primal/dual warm start by one stage before every solve, so that the initial guess and the working set
+    // of the QP solver (kept in the persistent solver memory, e.g. qpOASES hotstart) match the receding horizon.
+    void set_shift_warm_start(bool shift)
+    {
+        shift_warm_start_ = shift;
+    }
+
+    // stage i takes the values of stage i + 1, the last stage keeps its values; with partial condensing the nodes are
+    // block_size stages apart, so only the inputs are shifted
+    void shift_warm_start()
+    {
+        if (w0_.is_empty())
+        {
+            return;
+        }
+        const size_t nx = prob_->nx();
+        const size_t nu = prob_->nu();
+
+        auto shift = [](std::vector<double> &v, const std::vector<size_t> &offsets, size_t n) {
+            for (size_t i = 0; i + 1 < offsets.size(); i++)
+            {
+                std::copy(v.begin() + offsets[i + 1], v.begin() + offsets[i + 1] + n, v.begin() + offsets[i]);
+            }
+        };
+
+        const bool condensed = prob_->condensing_block() > 1;
+        std::vector<double> w = w0_.nonzeros();
+        std::vector<double> lam_x = lam_x0_.nonzeros();
+        shift(w, u_offsets_, nu);
+        shift(lam_x, u_offsets_, nu);
+        if (!condensed)
+        {
+            shift(w, x_offsets_, nx);
+            shift(lam_x, x_offsets_, nx);
+        }
+
+        // without condensing a QP stage is a shooting interval, its rows take the multipliers of the next stage where
+        // the row counts match. A stage of the condensed problem spans condensing_block() intervals, a shift by one
+        // interval has no counterpart there, so the multipliers start from zero
+        std::vector<double> lam_g = lam_g0_.nonzeros();
+        if (!condensed)
+        {
+            for (size_t k = 0; k + 1 < g_stages_.size(); k++)
+            {
+                const GStage &st = g_stages_[k], &next = g_stages_[k + 1];
+                if (st.dyn_size == next.dyn_size)
+                {
+                    std::copy_n(lam_g.begin() + next.dyn_start, st.dyn_size, lam_g.begin() + st.dyn_start);
+                }
+                if (st.con_size == next.con_size)
+                {
+                    std::copy_n(lam_g.begin() + next.con_start, st.con_size, lam_g.begin() + st.con_start);
+                }
+            }
+        }
+        else
+        {
+            std::fill(lam_g.begin(), lam_g.end(), 0.0);
+        }
+
+        w0_ = w;
+        lam_x0_ = lam_x;
+        lam_g0_ = lam_g;
+    }
+
+    // Soft builds the softened solver right away, so the first violation does not pay for the build
+    void set_initial_state_policy(InitialStatePolicy policy, double soft_weight = 1e3)
+    {
+        initial_state_policy_ = policy;
+        if (policy == InitialStatePolicy::Soft && (soft_solver_.is_null() || soft_weight != soft_weight_))
+        {
+            soft_weight_ = soft_weight;
+            build_soft_solver();
+        }
+    }
+    InitialStatePolicy initial_state_policy() const
+    {
+        return initial_state_policy_;
+    }
+    // components of x0 outside the state bounds in the last solve (empty if none)
+    const std::vector<size_t> &initial_state_violations() const
+    {
+        return violated_;
+    }
+
+    // statistics of the last solve
+    casadi::Dict stats() const
+    {
+        return last_solver_.is_null() ? solver_.stats() : last_solver_.stats();
+    }
+    int iterations() const
+    {
+        auto stats = this->stats();
+        return stats.count("iter_count") ? stats.at("iter_count").as_int() : -1;
+    }
+
+    // bounds as passed to the solver, the first nx entries of lbx/ubx are overwritten by x0 in solve()
+    casadi::DM lbx() const
+    {
+        return casadi::DM::vertcat(lbw_);
+    }
+    casadi::DM ubx() const
+    {
+        return casadi::DM::vertcat(ubw_);
+    }
+    casadi::DM lbg() const
+    {
+        return casadi::DM::vertcat(lbg_);
+    }
+    casadi::DM ubg() const
+    {
+        return casadi::DM::vertcat(ubg_);
+    }
+
   private:
+    struct BoundRestore
+    {
+        std::vector<std::tuple<std::vector<casadi::DM> *, size_t, casadi::DM>> saved;
+
+        void set(std::vector<casadi::DM> &bounds, size_t row, double value)
+        {
+            saved.emplace_back(&bounds, row, bounds[row]);
+            bounds[row] = value;
+        }
+        void apply()
+        {
+            for (auto it = saved.rbegin(); it != saved.rend(); ++it)
+            {
+                (*std::get<0>(*it))[std::get<1>(*it)] = std::get<2>(*it);
+            }
+            saved.clear();
+        }
+        ~BoundRestore()
+        {
+            apply();
+        }
+    };
+
+    // Widens the bounds of X_1..X_N so that braking at the input limit from x0 stays feasible. For each joint with a
+    // violated position or velocity the trajectory that accelerates back towards the bounds (velocity within its
+    // bounds once reached) is rolled out, and every stage bound of that joint is widened to include it, so the
+    // violation shrinks by the largest possible step per stage. Assumes the x = [q, q_dot], u = q_ddot layout of the
+    // planner problems; for other problems the violated bounds are widened to x0 on all stages.
+    void relax_state_bounds(const Eigen::VectorXd &x0, BoundRestore &restore)
+    {
+        const size_t nx = prob_->nx();
+        const size_t nu = prob_->nu();
+        const size_t N = prob_->horizon();
+        const double dt = prob_->dt();
+        const auto &x_bounds = prob_->x_bounds_;
+        const auto &u_bounds = prob_->u_bounds_;
+
+        auto widen = [&](size_t k, size_t l, double value) {
+            const auto &bound = x_bounds[k - 1];
+            auto &lb = x_bound_rows_[k - 1].first ? lbg_ : lbw_;
+            auto &ub = x_bound_rows_[k - 1].first ? ubg_ : ubw_;
+            const size_t row = x_bound_rows_[k - 1].second + l;
+            if (value < bound.first[l])
+            {
+                restore.set(lb, row, value);
+            }
+            if (value > bound.second[l])
+            {
+                restore.set(ub, row, value);
+            }
+        };
+
+        if (nx != 2 * nu)
+        {
+            for (size_t k = 1; k <= N; k++)
+            {
+                for (size_t l : violated_)
+                {
+                    widen(k, l, x0[l]);
+                }
+            }
+            return;
+        }
+
+        std::vector<bool> joints(nu, false);
+        for (size_t l : violated_)
+        {
+            joints[l % nu] = true;
+        }
+        for (size_t j = 0; j < nu; j++)
+        {
+            if (!joints[j])
+            {
+                continue;
+            }
+            double q = x0[j], v = x0[nu + j];
+            const auto &bound_1 = x_bounds[0];
+            // towards the bounds: down if q or (with q inside) v is above them
+            bool down = q > bound_1.second[j] || (q >= bound_1.first[j] && v > bound_1.second[nu + j]);
+            for (size_t k = 1; k <= N; k++)
+            {
+                const auto &bound = x_bounds[k - 1];
+                double a = down ? u_bounds[k - 1].first[j] : u_bounds[k - 1].second[j];
+                double v_next = v + a * dt;
+                // stop accelerating once the velocity bound is reached, but never against the braking direction
+                v_next = down ? std::max(v_next, std::min(v, bound.first[nu + j]))
+                              : std::min(v_next, std::max(v, bound.second[nu + j]));
+                // the farther of the explicit Euler and the exact step, valid for every integrator of Problem
+                double q_euler = q + v * dt, q_exact = q + 0.5 * (v + v_next) * dt;
+                q = down ? std::max(q_euler, q_exact) : std::min(q_euler, q_exact);
+                v = v_next;
+                widen(k, j, q);
+                widen(k, nu + j, v);
+            }
+        }
+    }
+
+    void record_failure(SolveStatus status, const Eigen::VectorXd &x0, const Eigen::VectorXd &p,
+                        const casadi::DM &w_solution)
+    {
+        auto to_eigen = [](const casadi::DM &v) {
+            std::vector<double> nz = v.nonzeros();
+            return Eigen::VectorXd(Eigen::Map<Eigen::VectorXd>(nz.data(), nz.size()));
+        };
+        last_status_ = status;
+        consecutive_failures_++;
+        failure_.status = status;
+        failure_.horizon = prob_->horizon();
+        failure_.dt = prob_->dt();
+        failure_.x0 = x0;
+        failure_.p = p;
+        failure_.w_guess = to_eigen(w0_);
+        failure_.w_solution = to_eigen(w_solution);
+    }
+
+    // Same NLP with slacks S >= 0 on the state bounds of X_1..X_N: lb <= X + S, X - S <= ub, cost soft_weight * sum(S).
+    // The slacks are appended to w and the softened bounds to g, so the warm start of the hard problem is a prefix.
+    void build_soft_solver()
+    {
+        using namespace casadi;
+        const size_t nx = prob_->nx();
+        MX w = casadi_prob_["x"];
+        std::vector<MX> g_soft = {casadi_prob_["g"]};
+        std::vector<MX> slacks;
+        soft_lbw_.assign(lbw_.begin(), lbw_.end());
+        soft_ubw_.assign(ubw_.begin(), ubw_.end());
+        soft_lbg_.assign(lbg_.begin(), lbg_.end());
+        soft_ubg_.assign(ubg_.begin(), ubg_.end());
+        std::vector<DM> lb_upper, ub_upper;
+        // X + S >= lb, X - S <= ub with the bounds of X moved from w (node states) or g (eliminated states)
+        for (size_t k = 0; k < x_bound_rows_.size(); k++)
+        {
+            const bool in_g = x_bound_rows_[k].first;
+            const size_t offset = x_bound_rows_[k].second;
+            std::vector<DM> &lb = in_g ? soft_lbg_ : soft_lbw_, &ub = in_g ? soft_ubg_ : soft_ubw_;
+            MX S = MX::sym("S_" + std::to_string(k + 1), nx, 1);
+            MX X = in_g ? casadi_prob_["g"](Slice(offset, offset + nx)) : w(Slice(offset, offset + nx));
+            slacks.push_back(S);
+            g_soft.push_back(X + S);
+            g_soft.push_back(X - S);
+            for (size_t l = 0; l < nx; l++)
+            {
+                size_t i = offset + l;
+                lb_upper.push_back(-inf);
+                ub_upper.push_back(ub[i]);
+                soft_lbg_.push_back(lb[i]);
+                soft_ubg_.push_back(inf);
+                lb[i] = -inf;
+                ub[i] = inf;
+            }
+            soft_lbg_.insert(soft_lbg_.end(), lb_upper.begin(), lb_upper.end());
+            soft_ubg_.insert(soft_ubg_.end(), ub_upper.begin(), ub_upper.end());
+            lb_upper.clear();
+            ub_upper.clear();
+        }
+        MX S_all = vertcat(slacks);
+        soft_lbw_.insert(soft_lbw_.end(), S_all.size1(), 0);
+        soft_ubw_.insert(soft_ubw_.end(), S_all.size1(), inf);
+
+        MXDict nlp = {{"x", vertcat(w, S_all)},
+                      {"f", casadi_prob_["f"] + soft_weight_ * sum1(S_all)},
+                      {"g", vertcat(g_soft)}};
+        if (casadi_prob_.count("p"))
+        {
+            nlp["p"] = casadi_prob_["p"];
+        }
+        // the slacks break the OCP stage layout that HPIPM was told about
+        Dict config = config_;
+        if (config.count("qpsol_options"))
+        {
+            Dict qp_options = config.at("qpsol_options").as_dict();
+            for (const char *dim : {"N", "nx", "nu", "ng"})
+            {
+                qp_options.erase(dim);
+            }
+            config["qpsol_options"] = qp_options;
+        }
+        soft_solver_ = nlpsol("soft_solver", solver_name_, nlp, config);
+    }
+
+    static std::vector<Eigen::VectorXd> columns(const casadi::DM &m)
+    {
+        std::vector<Eigen::VectorXd> cols;
+        for (casadi_int k = 0; k < m.size2(); k++)
+        {
+            // dense, structural zeros included
+            std::vector<double> c = static_cast<std::vector<double>>(m(casadi::Slice(), k));
+            cols.push_back(Eigen::Map<Eigen::VectorXd>(c.data(), c.size()));
+        }
+        return cols;
+    }
+
+    // <cache without .casadi>_<FNV-1a of the NLP structure, plugin and options>.casadi
+    std::string structure_cache_file(const std::string &cache) const
+    {
+        using namespace casadi;
+        MX p = casadi_prob_.count("p") ? casadi_prob_.at("p") : MX::sym("p", 0, 1);
+        Function nlp("nlp", {casadi_prob_.at("x"), p}, {casadi_prob_.at("f"), casadi_prob_.at("g")});
+        uint64_t h = 1469598103934665603ull;
+        for (char c : nlp.serialize() + solver_name_ + str(config_))
+        {
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+        const std::string ext = ".casadi";
+        bool has_ext = cache.size() > ext.size() && cache.compare(cache.size() - ext.size(), ext.size(), ext) == 0;
+        return (has_ext ? cache.substr(0, cache.size() - ext.size()) : cache) + "_" + hex + ext;
+    }
+
+    // HPIPM solves the QP of sqpmethod as an OCP when it is told the stage dimensions, otherwise it treats it as one
+    // dense stage. A stage of that QP is a block of condensing_block() shooting intervals: x_k is the node state, u_k
+    // all inputs of the block and the general constraints are the block's rows of g. The dimensions are only passed
+    // when the Jacobian of g keeps to the stage layout, a constraint that couples a node state with the input of the
+    // previous block does not
+    casadi::Dict with_qp_structure(casadi::Dict config) const
+    {
+        using namespace casadi;
+        auto qpsol = config.find("qpsol");
+        if (solver_name_ != "sqpmethod" || qpsol == config.end() || qpsol->second.to_string() != "hpipm")
+        {
+            return config;
+        }
+        Dict qp_options = config.count("qpsol_options") ? config.at("qpsol_options").as_dict() : Dict();
+        if (qp_options.count("N"))
+        {
+            return config;
+        }
+
+        const size_t nx = prob_->nx();
+        const size_t nw = lbw_.size();
+        const size_t Nb = x_offsets_.size() - 1;
+        auto stage_end = [&](size_t k) { return k < Nb ? x_offsets_[k + 1] : nw; };
+        std::vector<size_t> row_stage(lbg_.size());
+        std::vector<bool> row_dyn(lbg_.size());
+        for (size_t k = 0; k <= Nb; k++)
+        {
+            const GStage &st = g_stages_[k];
+            std::fill(row_stage.begin() + st.dyn_start, row_stage.begin() + st.con_start + st.con_size, k);
+            std::fill(row_dyn.begin() + st.dyn_start, row_dyn.begin() + st.dyn_start + st.dyn_size, true);
+        }
+        std::vector<casadi_int> rows, cols;
+        MX::jacobian(casadi_prob_.at("g"), casadi_prob_.at("x")).sparsity().get_triplet(rows, cols);
+        for (size_t j = 0; j < rows.size(); j++)
+        {
+            const size_t k = row_stage[rows[j]];
+            const size_t col = cols[j];
+            const size_t end = row_dyn[rows[j]] ? stage_end(k) + nx : stage_end(k);
+            if (col < x_offsets_[k] || col >= end)
+            {
+                return config;
+            }
+        }
+
+        std::vector<casadi_int> nx_stage(Nb + 1, nx), nu_stage, ng_stage;
+        for (size_t k = 0; k <= Nb; k++)
+        {
+            nu_stage.push_back(stage_end(k) - x_offsets_[k] - nx);
+            ng_stage.push_back(g_stages_[k].con_size);
+        }
+        nu_stage.pop_back();
+        qp_options["N"] = static_cast<casadi_int>(Nb);
+        qp_options["nx"] = nx_stage;
+        qp_options["nu"] = nu_stage;
+        qp_options["ng"] = ng_stage;
+        config["qpsol_options"] = qp_options;
+        return config;
+    }
+
+    casadi::Function build_solver(const std::string &base_cache)
+    {
+        const std::string cache = base_cache.empty() ? "" : structure_cache_file(base_cache);
+        solver_cache_file_ = cache;
+        if (!cache.empty() && std::ifstream(cache).good())
+        {
+            try
+            {
+                casadi::Function solver = casadi::Function::load(cache);
+                if (solver.nnz_in("x0") == static_cast<casadi_int>(lbw_.size()) &&
+                    solver.nnz_in("lbg") == static_cast<casadi_int>(lbg_.size()) &&
+                    solver.nnz_in("p") == static_cast<casadi_int>(prob_->np()))
+                {
+                    solver_from_cache_ = true;
+                    return solver;
+                }
+            }
+            catch (const std::exception &)
+            {
+                // corrupt or from another CasADi version
+            }
+            // rebuilt and overwritten below
+        }
+        casadi::Function solver = casadi::nlpsol("solver", solver_name_, casadi_prob_, config_);
+        if (!cache.empty())
+        {
+            // written to a temporary file first, so a concurrent reader never loads a partial file
+            std::string tmp = cache + ".tmp";
+            try
+            {
+                solver.save(tmp);
+                std::rename(tmp.c_str(), cache.c_str());
+            }
+            catch (const std::exception &)
+            {
+                // the plugin does not support serialization, the solver is rebuilt next time
+                std::remove(tmp.c_str());
+            }
+        }
+        return solver;
+    }
+
+    // solves the softened problem from the arguments of the hard one, returns the hard problem's part of the solution
+    casadi::DMDict solve_soft(casadi::DMDict arg)
+    {
+        using namespace casadi;
+        const size_t nw = lbw_.size();
+        const size_t ng = lbg_.size();
+        if (soft_solver_.is_null())
+        {
+            build_soft_solver();
+        }
+        const casadi_int ns = soft_lbw_.size() - nw;
+        const casadi_int ng_soft = soft_lbg_.size() - ng;
+
+        // the X_0 pin carries over
+        std::vector<DM> lbw = soft_lbw_, ubw = soft_ubw_;
+        std::copy(lbw_.begin(), lbw_.begin() + prob_->nx(), lbw.begin());
+        std::copy(ubw_.begin(), ubw_.begin() + prob_->nx(), ubw.begin());
+        arg["lbx"] = vertcat(lbw);
+        arg["ubx"] = vertcat(ubw);
+        arg["lbg"] = vertcat(soft_lbg_);
+        arg["ubg"] = vertcat(soft_ubg_);
+        auto extend = [](const DM &v, casadi_int n) { return v.is_empty() ? v : vertcat(v, DM::zeros(n, 1)); };
+        arg["x0"] = extend(arg["x0"], ns);
+        arg["lam_x0"] = extend(arg["lam_x0"], ns);
+        arg["lam_g0"] = extend(arg["lam_g0"], ng_soft);
+
+        DMDict sol = soft_solver_(arg);
+        sol["x"] = sol["x"](Slice(0, nw));
+        sol["lam_x"] = sol["lam_x"](Slice(0, nw));
+        sol["g"] = sol["g"](Slice(0, ng));
+        sol["lam_g"] = sol["lam_g"](Slice(0, ng));
+        return sol;
+    }
+
+    // input of the last good plan for the current tick, held at its last stage
+    Eigen::VectorXd fallback_input()
+    {
+        const size_t nu = prob_->nu();
+        if (last_good_w_.is_empty())
+        {
+            return Eigen::VectorXd::Zero(nu);
+        }
+        ticks_since_good_++;
+        size_t k = std::min(ticks_since_good_, prob_->horizon() - 1);
+        std::vector<double> u = inputs_fn_(last_good_w_)[0](casadi::Slice(), k).nonzeros();
+        return Eigen::Map<Eigen::VectorXd>(u.data(), nu);
+    }
+
     std::shared_ptr<Problem> prob_;
     std::string solver_name_;
     casadi::Dict config_;
@@ -417,9 +1397,40 @@ class MPC
     std::vector<casadi::DM> lbg_;
     std::vector<casadi::DM> ubg_;
 
+    // offsets of the shooting nodes (X_0..X_N without condensing) and (without B-spline inputs) U_0..U_{N-1} in w
+    std::vector<size_t> x_offsets_;
+    std::vector<size_t> u_offsets_;
+    // rows of the bounds of X_1..X_N: in lbg_/ubg_ (eliminated by condensing) or in lbw_/ubw_, and the offset
+    std::vector<std::pair<bool, size_t>> x_bound_rows_;
+    // rows of g per QP stage: the continuity of the next node, then the bounds and path constraints of the block
+    struct GStage
+    {
+        size_t dyn_start, dyn_size, con_start, con_size;
+    };
+    std::vector<GStage> g_stages_;
+    bool shift_warm_start_ = false;
+
     casadi::DM w0_;
     casadi::DM lam_x0_;
     casadi::DM lam_g0_;
+
+    // decision variables -> [U_0 ... U_{N-1}] and [X_0 ... X_N]
+    casadi::Function inputs_fn_;
+    casadi::Function states_fn_;
+
+    InitialStatePolicy initial_state_policy_ = InitialStatePolicy::Pin;
+    std::vector<size_t> violated_;
+    double soft_weight_ = 1e3;
+    casadi::Function soft_solver_;
+    casadi::Function last_solver_;
+    std::vector<casadi::DM> soft_lbw_, soft_ubw_, soft_lbg_, soft_ubg_;
+    casadi::DM last_good_w_;
+    bool solver_from_cache_ = false;
+    std::string solver_cache_file_;
+    size_t ticks_since_good_ = 0;
+    SolveStatus last_status_ = SolveStatus::Success;
+    size_t consecutive_failures_ = 0;
+    FailurePoint failure_;
 };
 
 } // namespace casadi_mpc_template
\ No newline at end of file
@@ -0,0 +1,290 @@
+#pragma once
+#include <nmpc_motion_planner/casadi_mpc_template.hpp>
+
+namespace casadi_mpc_template
+{
+
+// Scenario-tree MPC with a single branching at the root.
+// The Problem is replicated for every scenario (one parameter vector per scenario, e.g. a target prediction), all
+// scenarios share the first input U_0 (non-anticipativity) and the weighted sum of the scenario costs is minimized.
+// The scenario subproblem is built once as a casadi::Function and evaluated for all scenarios through map(), so the
+// scenario costs, constraints and their derivatives are evaluated in parallel.
+class ScenarioMPC
+{
+  public:
+    // expand would inline the mapped scenario function into one flat SX graph and lose the parallel evaluation
+    static casadi::Dict default_config()
+    {
+        casadi::Dict config = {{"calc_lam_p", true},
+                               {"calc_lam_x", true},
+                               {"ipopt.sb", "yes"},
+                               {"ipopt.print_level", 0},
+                               {"print_time", false},
+                               {"ipopt.warm_start_init_point", "yes"}};
+        return config;
+    }
+
+    template <class T>
+    ScenarioMPC(std::shared_ptr<T> prob, size_t num_scenarios, std::vector<double> weights = {},
+                std::string solver_name = "ipopt", casadi::Dict config = default_config(),
+                std::string parallelization = "thread")
+        : prob_(prob), ns_(num_scenarios), weights_(weights), solver_name_(solver_name), config_(config)
+    {
+        using namespace casadi;
+        static_assert(std::is_base_of_v<Problem, T>, "prob must be based SimpleProb");
+
+        const size_t nx = prob_->nx();
+        const size_t nu = prob_->nu();
+        const size_t N = prob_->horizon();
+        const double inf = std::numeric_limits<double>::infinity();
+
+        if (weights_.empty())
+        {
+            weights_ = std::vector<double>(ns_, 1.0 / ns_);
+        }
+
+        // single scenario subproblem: (X, U, p) -> (J, g), U(:, 0) is the shared first stage input
+        MX X = MX::sym("X", nx, N + 1);
+        MX U = MX::sym("U", nu, N);
+        MX J = 0;
+        std::vector<MX> g;
+        std::vector<double> lbg, ubg;
+
+        auto dynamics = prob_->discrete_dynamics();
+        for (size_t i = 0; i < N; i++)
+        {
+            MX x = X(Slice(), i);
+            MX u = U(Slice(), i);
+            MX x_next = X(Slice(), i + 1);
+
+            J += prob_->stage_cost(x, u, i);
+
+            g.push_back(dynamics(x, u) - x_next);
+            lbg.insert(lbg.end(), nx, 0);
+            ubg.insert(ubg.end(), nx, 0);
+
+            for (auto &con : prob_->equality_constrinats_)
+            {
+                auto con_val = con(x_next, u);
+                g.push_back(con_val);
+                lbg.insert(lbg.end(), con_val.size1(), 0);
+                ubg.insert(ubg.end(), con_val.size1(), 0);
+            }
+            for (auto &con : prob_->inequality_constrinats_)
+            {
+                auto con_val = con(x_next, u);
+                g.push_back(con_val);
+                lbg.insert(lbg.end(), con_val.size1(), -inf);
+                ubg.insert(ubg.end(), con_val.size1(), 0);
+            }
+        }
+        J += prob_->terminal_cost(X(Slice(), N));
+
+        Function scenario("scenario", {X, U, prob_->parameter()}, {J, vertcat(g)}, {"X", "U", "p"}, {"J", "g"});
+        Function scenarios = scenario.map(ns_, parallelization);
+
+        // decision variables: w = [U_0, X^0, U^0_{1..N-1}, X^1, U^1_{1..N-1}, ...]
+        U0_ = MX::sym("U_0", nu, 1);
+        P_ = MX::sym("P", prob_->np(), ns_);
+
+        auto &u_bounds = prob_->u_bounds_;
+        auto &x_bounds = prob_->x_bounds_;
+
+        std::vector<MX> w, X_all, U_all;
+        w.push_back(U0_);
+        for (auto l = 0; l < nu; l++)
+        {
+            lbw_.push_back(u_bounds[0].first[l]);
+            ubw_.push_back(u_bounds[0].second[l]);
+        }
+
+        for (size_t s = 0; s < ns_; s++)
+        {
+            MX Xs = MX::sym("X^" + std::to_string(s), nx, N + 1);
+            MX Us = MX::sym("U^" + std::to_string(s), nu, N - 1);
+
+            x0_offsets_.push_back(lbw_.size());
+            w.push_back(vec(Xs));
+            for (size_t i = 0; i <= N; i++)
+            {
+                for (auto l = 0; l < nx; l++)
+                {
+                    // the initial state is pinned to x0 in solve()
+                    lbw_.push_back(i == 0 ? 0 : x_bounds[i - 1].first[l]);
+                    ubw_.push_back(i == 0 ? 0 : x_bounds[i - 1].second[l]);
+                }
+            }
+
+            w.push_back(vec(Us));
+            for (size_t i = 1; i < N; i++)
+            {
+                for (auto l = 0; l < nu; l++)
+                {
+                    lbw_.push_back(u_bounds[i].first[l]);
+                    ubw_.push_back(u_bounds[i].second[l]);
+                }
+            }
+
+            X_all.push_back(Xs);
+            U_all.push_back(horzcat(U0_, Us));
+
+            lbg_.insert(lbg_.end(), lbg.begin(), lbg.end());
+            ubg_.insert(ubg_.end(), ubg.begin(), ubg.end());
+        }
+
+        auto res = scenarios(std::vector<MX>{horzcat(X_all), horzcat(U_all), P_});
+        MX J_all = mtimes(res[0], MX(DM(weights_)));
+
+        casadi_prob_ = {{"x", vertcat(w)}, {"f", J_all}, {"g", vec(res[1])}};
+        if (prob_->np() > 0)
+        {
+            casadi_prob_["p"] = vec(P_);
+        }
+        solver_ = nlpsol("solver", solver_name_, casadi_prob_, config_);
+    }
+
+    // params[s] is the parameter vector of scenario s
+    Eigen::VectorXd solve(Eigen::VectorXd x0, const std::vector<Eigen::VectorXd> &params = {})
+    {
+        using namespace casadi;
+        const size_t nx = prob_->nx();
+        const size_t nu = prob_->nu();
+
+        // same guard as MPC::solve: invalid inputs or an invalid solution (valid_solution) keep the last good plan
+        bool valid = static_cast<size_t>(x0.size()) == nx && x0.allFinite() &&
+                     (prob_->np() == 0 || params.size() == ns_);
+        for (size_t s = 0; valid && prob_->np() > 0 && s < ns_; s++)
+        {
+            valid = static_cast<size_t>(params[s].size()) == prob_->np() && params[s].allFinite();
+        }
+        if (!valid)
+        {
+            return fail(SolveStatus::InvalidInput);
+        }
+
+        for (auto offset : x0_offsets_)
+        {
+            for (auto l = 0; l < nx; l++)
+            {
+                lbw_[offset + l] = x0[l];
+                ubw_[offset + l] = x0[l];
+            }
+        }
+
+        DMDict arg;
+        arg["x0"] = w0_;
+        arg["lbx"] = lbw_;
+        arg["ubx"] = ubw_;
+        arg["lbg"] = lbg_;
+        arg["ubg"] = ubg_;
+        arg["lam_x0"] = lam_x0_;
+        arg["lam_g0"] = lam_g0_;
+        if (prob_->np() > 0)
+        {
+            std::vector<double> p;
+            for (auto &p_s : params)
+            {
+                p.insert(p.end(), p_s.data(), p_s.data() + p_s.size());
+            }
+            arg["p"] = p;
+        }
+        DMDict sol = solver_(arg);
+
+        const Dict stats = solver_.stats();
+        if (!valid_solution(sol, stats))
+        {
+            return fail(SolveStatus::InvalidSolution);
+        }
+        last_status_ = stats.at("success").as_bool() ? SolveStatus::Success : SolveStatus::NotConverged;
+        consecutive_failures_ = 0;
+        ticks_since_good_ = 0;
+
+        w0_ = sol["x"];
+        lam_x0_ = sol["lam_x"];
+        lam_g0_ = sol["lam_g"];
+        last_good_w_ = w0_;
+
+        Eigen::VectorXd opt_u(nu);
+        std::copy(w0_.ptr(), w0_.ptr() + nu, opt_u.data());
+
+        return opt_u;
+    }
+
+    casadi::Dict stats() const
+    {
+        return solver_.stats();
+    }
+    int iterations() const
+    {
+        auto stats = solver_.stats();
+        return stats.count("iter_count") ? stats.at("iter_count").as_int() : -1;
+    }
+
+    // see MPC::status(), the fallback follows the inputs of the first scenario of the last good plan
+    SolveStatus status() const
+    {
+        return last_status_;
+    }
+    size_t consecutive_failures() const
+    {
+        return consecutive_failures_;
+    }
+
+    size_t num_scenarios() const
+    {
+        return ns_;
+    }
+
+    casadi::MXDict casadi_prob() const
+    {
+        return casadi_prob_;
+    }
+
+  private:
+    Eigen::VectorXd fail(SolveStatus status)
+    {
+        const size_t nx = prob_->nx();
+        const size_t nu = prob_->nu();
+        const size_t N = prob_->horizon();
+        last_status_ = status;
+        consecutive_failures_++;
+        if (last_good_w_.is_empty())
+        {
+            return Eigen::VectorXd::Zero(nu);
+        }
+        // U^0_k for k >= 1 follows X^0 in w, held at the last stage
+        ticks_since_good_++;
+        size_t k = std::min(ticks_since_good_, N - 1);
+        size_t offset = k == 0 ? 0 : x0_offsets_[0] + nx * (N + 1) + (k - 1) * nu;
+        Eigen::VectorXd u(nu);
+        std::copy(last_good_w_.ptr() + offset, last_good_w_.ptr() + offset + nu, u.data());
+        return u;
+    }
+
+    std::shared_ptr<Problem> prob_;
+    size_t ns_;
+    std::vector<double> weights_;
+    std::string solver_name_;
+    casadi::Dict config_;
+    casadi::MXDict casadi_prob_;
+    casadi::Function solver_;
+    casadi::MX U0_;
+    casadi::MX P_;
+
+    std::vector<size_t> x0_offsets_;
+    std::vector<double> lbw_;
+    std::vector<double> ubw_;
+    std::vector<double> lbg_;
+    std::vector<double> ubg_;
+
+    casadi::DM w0_;
+    casadi::DM lam_x0_;
+    casadi::DM lam_g0_;
+    casadi::DM last_good_w_;
+
+    SolveStatus last_status_ = SolveStatus::Success;
+    size_t consecutive_failures_ = 0;
+    size_t ticks_since_good_ = 0;
+};
+
+} // namespace casadi_mpc_template
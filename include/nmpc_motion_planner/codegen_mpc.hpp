@@ -0,0 +1,149 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+
+// <name>_config.h is generated by nmpc_codegen, NMPC_CODEGEN_DIR has to be on the include path
+
+namespace casadi_mpc_template
+{
+
+// Wrapper around a code generated solver with the interface of MPC.
+// Solver is the <name>_traits struct from <name>_config.h. Every buffer is a fixed size member sized by nmpc_codegen,
+// the solver neither allocates nor needs the CasADi runtime, so an instance (e.g. a static one) can be used from a
+// hard real-time task through the pointer overload. The interface is in double regardless of Solver::real.
+template <class Solver> class CodegenMPC
+{
+  public:
+    using real = typename Solver::real;
+    static constexpr int nx = Solver::nx;
+    static constexpr int nu = Solver::nu;
+    static constexpr int np = Solver::np;
+    static constexpr int nw = Solver::nw;
+    static constexpr int ng = Solver::ng;
+
+    CodegenMPC()
+    {
+        std::copy(Solver::lbx(), Solver::lbx() + nw, lbx_);
+        std::copy(Solver::ubx(), Solver::ubx() + nw, ubx_);
+        std::fill(w0_, w0_ + nw, real(0));
+        std::fill(lam_x0_, lam_x0_ + nw, real(0));
+        std::fill(lam_g0_, lam_g0_ + ng_buf, real(0));
+        std::fill(p_, p_ + np_buf, real(0));
+    }
+
+    // real-time safe: x0[nx], p[np], u[nu]; returns the status of the generated solver (0 on success)
+    int solve(const double *x0, const double *p, double *u)
+    {
+        std::copy(x0, x0 + nx, lbx_);
+        std::copy(x0, x0 + nx, ubx_);
+        std::copy(p, p + np, p_);
+
+        arg_[0] = w0_;
+        arg_[1] = p_;
+        arg_[2] = lbx_;
+        arg_[3] = ubx_;
+        arg_[4] = Solver::lbg();
+        arg_[5] = Solver::ubg();
+        arg_[6] = lam_x0_;
+        arg_[7] = lam_g0_;
+
+        res_[0] = w_opt_;
+        res_[1] = &f_;
+        res_[2] = g_;
+        res_[3] = lam_x_;
+        res_[4] = lam_g_;
+        res_[5] = lam_p_;
+
+        int status = Solver::eval(arg_, res_, iw_, w_);
+
+        std::copy(w_opt_, w_opt_ + nw, w0_);
+        std::copy(lam_x_, lam_x_ + nw, lam_x0_);
+        std::copy(lam_g_, lam_g_ + ng_buf, lam_g0_);
+        std::copy(w0_ + nx, w0_ + nx + nu, u);
+        return status;
+    }
+
+    Eigen::VectorXd solve(Eigen::VectorXd x0, Eigen::VectorXd p = Eigen::VectorXd::Zero(np))
+    {
+        Eigen::VectorXd opt_u(nu);
+        solve(x0.data(), p.data(), opt_u.data());
+        return opt_u;
+    }
+
+    // primal/dual solution of the last solve, used to hand over between precisions
+    template <class Other> void copy_warm_start(const CodegenMPC<Other> &other)
+    {
+        static_assert(Other::nw == Solver::nw && Other::ng == Solver::ng, "solvers must share the NLP");
+        std::copy(other.w0_, other.w0_ + nw, w0_);
+        std::copy(other.lam_x0_, other.lam_x0_ + nw, lam_x0_);
+        std::copy(other.lam_g0_, other.lam_g0_ + ng_buf, lam_g0_);
+    }
+
+    // end effector transform (4x4, column major) of the joint positions q
+    static void forward_kinematics(const double *q, double *T)
+    {
+        real q_r[6], T_r[16], w[Solver::fk_sz_w > 0 ? Solver::fk_sz_w : 1];
+        const real *arg[1] = {q_r};
+        real *res[1] = {T_r};
+        std::copy(q, q + 6, q_r);
+        Solver::fk(arg, res, nullptr, w);
+        std::copy(T_r, T_r + 16, T);
+    }
+
+  private:
+    template <class Other> friend class CodegenMPC;
+
+    // zero sized arrays are not allowed
+    static constexpr int ng_buf = ng > 0 ? ng : 1;
+    static constexpr int np_buf = np > 0 ? np : 1;
+
+    const real *arg_[Solver::sz_arg];
+    real *res_[Solver::sz_res];
+    long long int iw_[Solver::sz_iw > 0 ? Solver::sz_iw : 1];
+    real w_[Solver::sz_w > 0 ? Solver::sz_w : 1];
+
+    real lbx_[nw];
+    real ubx_[nw];
+    real p_[np_buf];
+    real w0_[nw];
+    real lam_x0_[nw];
+    real lam_g0_[ng_buf];
+
+    real w_opt_[nw];
+    real f_;
+    real g_[ng_buf];
+    real lam_x_[nw];
+    real lam_g_[ng_buf];
+    real lam_p_[np_buf];
+};
+
+// Solves in single precision (twice the SIMD width, half the memory traffic) and refines the result with a double
+// precision solver generated with a single SQP iteration (nmpc_codegen --max-iter 1), warm started from the float
+// solution. The float solver is warm started from its own previous solution, not from the refined one.
+template <class FloatSolver, class RefineSolver> class MixedPrecisionMPC
+{
+  public:
+    static constexpr int nu = FloatSolver::nu;
+    static constexpr int np = FloatSolver::np;
+
+    int solve(const double *x0, const double *p, double *u)
+    {
+        int status = solver_.solve(x0, p, u);
+        refine_.copy_warm_start(solver_);
+        int refine_status = refine_.solve(x0, p, u);
+        return status != 0 ? status : refine_status;
+    }
+
+    Eigen::VectorXd solve(Eigen::VectorXd x0, Eigen::VectorXd p = Eigen::VectorXd::Zero(np))
+    {
+        Eigen::VectorXd opt_u(nu);
+        solve(x0.data(), p.data(), opt_u.data());
+        return opt_u;
+    }
+
+  private:
+    CodegenMPC<FloatSolver> solver_;
+    CodegenMPC<RefineSolver> refine_;
+};
+
+} // namespace casadi_mpc_template
@@ -0,0 +1,145 @@
+#pragma once
+#include <Eigen/Dense>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace casadi_mpc_template
+{
+
+enum class SolveStatus
+{
+    Success,
+    NotConverged,    // finite solution, but the solver did not report success (e.g. iteration limit, RTI), used as is
+    InvalidInput,    // NaN/Inf or wrong size in x0 or p, the solver is not called
+    InvalidSolution, // NaN/Inf in the solution or multipliers, or IPOPT stopped on an invalid number / failed step
+};
+
+inline const char *to_string(SolveStatus status)
+{
+    switch (status)
+    {
+    case SolveStatus::Success:
+        return "success";
+    case SolveStatus::NotConverged:
+        return "not converged";
+    case SolveStatus::InvalidInput:
+        return "invalid input";
+    case SolveStatus::InvalidSolution:
+    default:
+        return "invalid solution";
+    }
+}
+
+// Inputs of a failed solve, written by the planner and read back by nmpc_diagnose. One "name: v0 v1 ..." line per
+// field, the lines of the problem description are prefixed with "problem.".
+struct FailurePoint
+{
+    SolveStatus status = SolveStatus::Success;
+    size_t horizon = 0;
+    double dt = 0.0;
+    Eigen::VectorXd x0, p;
+    Eigen::VectorXd w_guess;    // initial guess passed to the solver
+    Eigen::VectorXd w_solution; // returned primal solution (may contain NaN/Inf)
+    std::string problem;        // ProblemSpec::canonical() of the solved problem, set by the planner
+
+    void save(const std::string &path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            throw std::runtime_error("failure point: cannot write " + path);
+        }
+        file.precision(17);
+        file << "status: " << static_cast<int>(status) << "\n";
+        file << "horizon: " << horizon << "\n";
+        file << "dt: " << dt << "\n";
+        auto write = [&](const char *name, const Eigen::VectorXd &v) {
+            file << name << ":";
+            for (int i = 0; i < v.size(); i++)
+            {
+                file << " " << v[i];
+            }
+            file << "\n";
+        };
+        write("x0", x0);
+        write("p", p);
+        write("w_guess", w_guess);
+        write("w_solution", w_solution);
+        std::istringstream problem_lines(problem);
+        std::string line;
+        while (std::getline(problem_lines, line))
+        {
+            file << "problem." << line << "\n";
+        }
+    }
+
+    static FailurePoint load(const std::string &path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            throw std::runtime_error("failure point: cannot open " + path);
+        }
+        FailurePoint point;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos)
+            {
+                continue;
+            }
+            std::string name = line.substr(0, colon);
+            if (name.compare(0, 8, "problem.") == 0)
+            {
+                point.problem += line.substr(8) + "\n";
+                continue;
+            }
+            std::istringstream values(line.substr(colon + 1));
+            // operator>> does not parse nan/inf
+            std::vector<double> v;
+            std::string token;
+            while (values >> token)
+            {
+                v.push_back(std::stod(token));
+            }
+            Eigen::VectorXd vec = Eigen::Map<Eigen::VectorXd>(v.data(), v.size());
+
+            if (name == "status" && !v.empty())
+            {
+                point.status = static_cast<SolveStatus>(static_cast<int>(v[0]));
+            }
+            else if (name == "horizon" && !v.empty())
+            {
+                point.horizon = static_cast<size_t>(v[0]);
+            }
+            else if (name == "dt" && !v.empty())
+            {
+                point.dt = v[0];
+            }
+            else if (name == "x0")
+            {
+                point.x0 = vec;
+            }
+            else if (name == "p")
+            {
+                point.p = vec;
+            }
+            else if (name == "w_guess")
+            {
+                point.w_guess = vec;
+            }
+            else if (name == "w_solution")
+            {
+                point.w_solution = vec;
+            }
+        }
+        return point;
+    }
+};
+
+} // namespace casadi_mpc_template
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <nmpc_motion_planner/nmpc_prob.hpp>
+#include <nmpc_motion_planner/solve_statistics.hpp>
+
+#include <chrono>
+
+namespace casadi_mpc_template
+{
+
+// Closed-loop simulation without ROS/Gazebo for benchmarks and tuning tools: the plant is the exact discretization of
+// the joint double integrator, the controller any type with solve(x0, p) and iterations() (MPC, ScenarioMPC-like).
+struct SimScenario
+{
+    std::string name;
+    Eigen::VectorXd x0;
+    Eigen::VectorXd p; // MotionPlanningProb::reference_parameter() of the target
+    size_t steps = 300;
+};
+
+struct SimResult
+{
+    SolveStatistics stats{100000};
+    std::vector<Eigen::VectorXd> states;
+    std::vector<Eigen::VectorXd> inputs;
+    double final_position_error = 0.0;
+    bool finite = true; // no NaN/Inf in any input
+};
+
+class HeadlessSimulator
+{
+  public:
+    explicit HeadlessSimulator(std::shared_ptr<MotionPlanningProb> prob) : prob_(prob)
+    {
+        casadi::MX q = casadi::MX::sym("q", prob_->nx() / 2);
+        pose_fn_ = casadi::Function("end_effector_pose", {q}, {prob_->end_effector_pose(q)});
+    }
+
+    template <class Controller> SimResult run(Controller &mpc, const SimScenario &scenario) const
+    {
+        const double dt = prob_->dt();
+        const size_t nq = prob_->nx() / 2;
+        SimResult result;
+        Eigen::VectorXd x = scenario.x0;
+        for (size_t k = 0; k < scenario.steps; k++)
+        {
+            auto t_start = std::chrono::steady_clock::now();
+            Eigen::VectorXd u = mpc.solve(x, scenario.p);
+            auto t_end = std::chrono::steady_clock::now();
+            result.stats.add(std::chrono::duration<double>(t_end - t_start).count(), mpc.iterations());
+
+            if (!u.allFinite())
+            {
+                result.finite = false;
+                break;
+            }
+            x.head(nq) += x.tail(nq) * dt + 0.5 * u * dt * dt;
+            x.tail(nq) += u * dt;
+            result.states.push_back(x);
+            result.inputs.push_back(u);
+        }
+        result.final_position_error = result.finite ? (pose(x.head(nq)).head(3) - scenario.p.head(3)).norm() : 1e9;
+        return result;
+    }
+
+    Eigen::VectorXd pose(const Eigen::VectorXd &q) const
+    {
+        casadi::DM q_dm = std::vector<double>(q.data(), q.data() + q.size());
+        std::vector<double> pose = pose_fn_(q_dm)[0].nonzeros();
+        return Eigen::Map<Eigen::VectorXd>(pose.data(), pose.size());
+    }
+
+    // reachable targets: the end effector pose of goal arm configurations, started at rest from the home pose; the arm
+    // joints are the last 6 of q, other joints (e.g. a mobile base) start and stay at zero in the goals
+    std::vector<SimScenario> default_scenarios(size_t steps = 300) const
+    {
+        const size_t nq = prob_->nx() / 2;
+        auto arm = [nq](std::initializer_list<double> joints) {
+            Eigen::VectorXd q = Eigen::VectorXd::Zero(nq);
+            q.tail(joints.size()) = Eigen::Map<const Eigen::VectorXd>(joints.begin(), joints.size());
+            return q;
+        };
+        Eigen::VectorXd home = arm({0.0, -1.0, 1.0, 0.0, 0.0, 0.0});
+        std::vector<std::pair<std::string, Eigen::VectorXd>> goals = {
+            {"small_move", arm({0.2, -1.1, 1.2, 0.1, 0.0, 0.0})},
+            {"large_move", arm({1.2, -0.6, 0.5, -0.8, 0.6, 0.4})},
+            {"reorient", arm({0.0, -1.0, 1.0, 1.2, -1.0, 1.5})},
+        };
+        std::vector<SimScenario> scenarios;
+        for (auto &goal : goals)
+        {
+            SimScenario scenario;
+            scenario.name = goal.first;
+            scenario.x0 = Eigen::VectorXd::Zero(prob_->nx());
+            scenario.x0.head(nq) = home;
+            scenario.p = pose(goal.second);
+            scenario.steps = steps;
+            scenarios.push_back(scenario);
+        }
+        return scenarios;
+    }
+
+  private:
+    std::shared_ptr<MotionPlanningProb> prob_;
+    casadi::Function pose_fn_;
+};
+
+} // namespace casadi_mpc_template
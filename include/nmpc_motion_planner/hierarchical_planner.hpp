@@ -0,0 +1,91 @@
+#pragma once
+
+#include <nmpc_motion_planner/joint_tracking_prob.hpp>
+#include <nmpc_motion_planner/solve_statistics.hpp>
+#include <nmpc_motion_planner/triple_buffer.hpp>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace casadi_mpc_template
+{
+
+// Two-rate MPC. The outer loop solves a long horizon NMPC with coarse dt (e.g. MotionPlanningProb with collision
+// constraints) at a low rate and hands its predicted state trajectory to the inner loop through a lock-free triple
+// buffer. The inner loop runs a short horizon JointTrackingProb with fine dt at a high rate on the plan sampled from
+// the current time on and sends its first input to the command callback. Each loop has its own thread, optionally
+// pinned to its own CPU, and never waits for the other. A failed outer solve publishes nothing, the inner loop keeps
+// tracking the last good plan at its original time.
+class HierarchicalPlanner
+{
+  public:
+    struct Config
+    {
+        double outer_rate = 10.0;
+        double inner_rate = 200.0;
+        int outer_cpu = -1;
+        int inner_cpu = -1;
+    };
+
+    struct Callbacks
+    {
+        // current time [s]
+        std::function<double()> clock;
+        // state estimate at a time, called from both loops
+        std::function<Eigen::VectorXd(double)> state;
+        // parameter of the outer problem
+        std::function<Eigen::VectorXd()> reference;
+        // input of the inner loop and its time
+        std::function<void(const Eigen::VectorXd &, double)> command;
+    };
+
+    // predicted states of the outer solve started at stamp, stage k at stamp + k * dt
+    struct Plan
+    {
+        double stamp = 0.0;
+        double dt = 0.0;
+        std::vector<Eigen::VectorXd> states;
+
+        // linear interpolation, held at the ends
+        Eigen::VectorXd state(double t) const;
+    };
+
+    HierarchicalPlanner(std::unique_ptr<MPC> outer, double outer_dt, std::unique_ptr<MPC> inner,
+                        std::shared_ptr<JointTrackingProb> inner_prob, Callbacks callbacks, Config config);
+    HierarchicalPlanner(std::unique_ptr<MPC> outer, double outer_dt, std::unique_ptr<MPC> inner,
+                        std::shared_ptr<JointTrackingProb> inner_prob, Callbacks callbacks)
+        : HierarchicalPlanner(std::move(outer), outer_dt, std::move(inner), inner_prob, callbacks, Config())
+    {
+    }
+    ~HierarchicalPlanner();
+
+    void start();
+    void stop();
+
+    // solve time/iteration percentiles of both loops
+    std::string summary() const;
+
+  private:
+    void outer_loop();
+    void inner_loop();
+
+    std::unique_ptr<MPC> outer_;
+    const double outer_dt_;
+    std::unique_ptr<MPC> inner_;
+    std::shared_ptr<JointTrackingProb> inner_prob_;
+    Callbacks callbacks_;
+    const Config config_;
+
+    TripleBuffer<Plan> plans_;
+
+    std::atomic<bool> running_{false};
+    std::thread outer_thread_, inner_thread_;
+
+    // one lock per loop, so the loops never wait for each other
+    mutable std::mutex outer_stats_mtx_, inner_stats_mtx_;
+    SolveStatistics outer_stats_, inner_stats_;
+};
+
+} // namespace casadi_mpc_template
@@ -0,0 +1,145 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace casadi_mpc_template
+{
+
+// Per-joint Kalman filter on [position, velocity] with the commanded acceleration as input and white acceleration
+// noise. Measurements are fused at their own stamps: out-of-order messages are rejected, a gap longer than
+// max_gap (e.g. after dropped messages) re-initializes the joint from the measurement, and predict() extrapolates the
+// filtered state to an arbitrary time such as the start of the next solve.
+class JointStateEstimator
+{
+  public:
+    JointStateEstimator(size_t num_joints, double accel_noise = 5.0, double position_noise = 1e-4,
+                        double velocity_noise = 2e-2, double max_gap = 0.1)
+        : n_(num_joints), accel_var_(accel_noise * accel_noise), pos_var_(position_noise * position_noise),
+          vel_var_(velocity_noise * velocity_noise), max_gap_(max_gap)
+    {
+        joints_.resize(n_);
+        accel_ = Eigen::VectorXd::Zero(n_);
+    }
+
+    // returns false if the measurement is rejected (older than the last fused one)
+    bool update(double stamp, const Eigen::VectorXd &position, const Eigen::VectorXd &velocity)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (initialized_ && stamp <= stamp_)
+        {
+            rejected_++;
+            return false;
+        }
+
+        const double dt = stamp - stamp_;
+        const bool reset = !initialized_ || dt > max_gap_;
+        if (initialized_ && reset)
+        {
+            resets_++;
+        }
+
+        for (size_t j = 0; j < n_; j++)
+        {
+            auto &joint = joints_[j];
+            Eigen::Vector2d z(position[j], velocity[j]);
+            if (reset)
+            {
+                joint.x = z;
+                joint.P = Eigen::Vector2d(pos_var_, vel_var_).asDiagonal();
+                continue;
+            }
+
+            predict_joint(joint, accel_[j], dt);
+
+            Eigen::Matrix2d S = joint.P;
+            S(0, 0) += pos_var_;
+            S(1, 1) += vel_var_;
+            Eigen::Matrix2d K = joint.P * S.inverse();
+            joint.x += K * (z - joint.x);
+            joint.P = (Eigen::Matrix2d::Identity() - K) * joint.P;
+        }
+
+        stamp_ = stamp;
+        initialized_ = true;
+        return true;
+    }
+
+    // commanded joint acceleration, used as known input between measurements
+    void set_acceleration(const Eigen::VectorXd &accel)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        accel_ = accel;
+    }
+
+    // [q; q_dot] predicted to stamp, the filter itself is left untouched
+    Eigen::VectorXd predict(double stamp) const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        Eigen::VectorXd x(2 * n_);
+        const double dt = initialized_ ? std::min(std::max(stamp - stamp_, 0.0), max_gap_) : 0.0;
+        for (size_t j = 0; j < n_; j++)
+        {
+            Joint joint = joints_[j];
+            predict_joint(joint, accel_[j], dt);
+            x[j] = joint.x[0];
+            x[n_ + j] = joint.x[1];
+        }
+        return x;
+    }
+
+    bool initialized() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return initialized_;
+    }
+    double stamp() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return stamp_;
+    }
+    size_t rejected() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return rejected_;
+    }
+    size_t resets() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return resets_;
+    }
+
+  private:
+    struct Joint
+    {
+        Eigen::Vector2d x = Eigen::Vector2d::Zero();
+        Eigen::Matrix2d P = Eigen::Matrix2d::Identity();
+    };
+
+    void predict_joint(Joint &joint, double accel, double dt) const
+    {
+        Eigen::Matrix2d F;
+        F << 1, dt, 0, 1;
+        Eigen::Vector2d G(0.5 * dt * dt, dt);
+
+        joint.x = F * joint.x + G * accel;
+        joint.P = F * joint.P * F.transpose() + accel_var_ * G * G.transpose();
+    }
+
+    const size_t n_;
+    const double accel_var_;
+    const double pos_var_;
+    const double vel_var_;
+    const double max_gap_;
+
+    mutable std::mutex mtx_;
+    std::vector<Joint> joints_;
+    Eigen::VectorXd accel_;
+    double stamp_ = 0.0;
+    bool initialized_ = false;
+    size_t rejected_ = 0;
+    size_t resets_ = 0;
+};
+
+} // namespace casadi_mpc_template
@@ -0,0 +1,63 @@
+#pragma once
+#include <nmpc_motion_planner/casadi_mpc_template.hpp>
+
+namespace casadi_mpc_template
+{
+
+// Joint space tracking of a state trajectory with the double integrator model x = [q; q_dot], u = q_ddot.
+// parameter() holds the reference states of stages 0..horizon, so the short horizon inner loop of a hierarchical
+// planner tracks the plan of the outer loop without forward kinematics in the problem.
+class JointTrackingProb : public Problem
+{
+  public:
+    JointTrackingProb(size_t num_joints, size_t horizon, double dt)
+        : Problem(DynamicsType::ContinuesRK4, 2 * num_joints, num_joints, horizon, dt)
+    {
+        set_parameter_dim(nx() * (horizon + 1));
+    }
+
+    using Problem::stage_cost;
+
+    casadi::MX dynamics(casadi::MX x, casadi::MX u) override
+    {
+        return casadi::MX::vertcat({x(casadi::Slice(nu(), nx())), u});
+    }
+
+    casadi::MX stage_cost(casadi::MX x, casadi::MX u, size_t stage) override
+    {
+        casadi::MX e = x - reference(stage);
+        casadi::MX e_q = e(casadi::Slice(0, nu()));
+        casadi::MX e_v = e(casadi::Slice(nu(), nx()));
+        return dt() * 0.5 * (w_position * dot(e_q, e_q) + w_velocity * dot(e_v, e_v) + w_input * dot(u, u));
+    }
+
+    casadi::MX terminal_cost(casadi::MX x) override
+    {
+        casadi::MX e = x - reference(horizon());
+        return 0.5 * w_terminal * dot(e, e);
+    }
+
+    // reference of stage k as a slice of parameter()
+    casadi::MX reference(size_t stage) const
+    {
+        return parameter()(casadi::Slice(stage * nx(), (stage + 1) * nx()));
+    }
+
+    // parameter vector from the reference states of stages 0..horizon
+    static Eigen::VectorXd reference_parameter(const std::vector<Eigen::VectorXd> &states)
+    {
+        Eigen::VectorXd p(states.size() * states.front().size());
+        for (size_t k = 0; k < states.size(); k++)
+        {
+            p.segment(k * states[k].size(), states[k].size()) = states[k];
+        }
+        return p;
+    }
+
+    double w_position = 1e3;
+    double w_velocity = 10.0;
+    double w_input = 1e-3;
+    double w_terminal = 1e2;
+};
+
+} // namespace casadi_mpc_template
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace casadi_mpc_template
+{
+
+// Metrics in the Prometheus text format. counter()/gauge()/histogram() register a metric on first use and return a
+// reference that stays valid for the lifetime of the registry; updating it does not lock the registry or allocate,
+// so it can be done from the control loop. Labels are given preformatted, e.g. R"(status="success")".
+class MetricsRegistry
+{
+  public:
+    class Metric
+    {
+      public:
+        virtual ~Metric() = default;
+        virtual void write(std::ostream &os, const std::string &name, const std::string &labels) const = 0;
+    };
+
+    class Counter : public Metric
+    {
+      public:
+        void inc(uint64_t n = 1)
+        {
+            value_.fetch_add(n, std::memory_order_relaxed);
+        }
+        uint64_t value() const
+        {
+            return value_.load(std::memory_order_relaxed);
+        }
+        void write(std::ostream &os, const std::string &name, const std::string &labels) const override
+        {
+            os << name << braces(labels) << " " << value() << "\n";
+        }
+
+      private:
+        std::atomic<uint64_t> value_{0};
+    };
+
+    class Gauge : public Metric
+    {
+      public:
+        void set(double value)
+        {
+            value_.store(value, std::memory_order_relaxed);
+        }
+        double value() const
+        {
+            return value_.load(std::memory_order_relaxed);
+        }
+        void write(std::ostream &os, const std::string &name, const std::string &labels) const override
+        {
+            os << name << braces(labels) << " " << value() << "\n";
+        }
+
+      private:
+        std::atomic<double> value_{0.0};
+    };
+
+    class Histogram : public Metric
+    {
+      public:
+        explicit Histogram(std::vector<double> bounds) : bounds_(std::move(bounds)), counts_(bounds_.size() + 1, 0)
+        {
+        }
+        void observe(double value)
+        {
+            size_t i = 0;
+            while (i < bounds_.size() && value > bounds_[i])
+            {
+                i++;
+            }
+            std::lock_guard<std::mutex> lock(mtx_);
+            counts_[i]++;
+            sum_ += value;
+        }
+        void write(std::ostream &os, const std::string &name, const std::string &labels) const override
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < counts_.size(); i++)
+            {
+                cumulative += counts_[i];
+                std::ostringstream le;
+                le.precision(9);
+                if (i < bounds_.size())
+                {
+                    le << bounds_[i];
+                }
+                else
+                {
+                    le << "+Inf";
+                }
+                os << name << "_bucket{" << (labels.empty() ? "" : labels + ",") << "le=\"" << le.str() << "\"} "
+                   << cumulative << "\n";
+            }
+            os << name << "_sum" << braces(labels) << " " << sum_ << "\n";
+            os << name << "_count" << braces(labels) << " " << cumulative << "\n";
+        }
+
+      private:
+        const std::vector<double> bounds_;
+        mutable std::mutex mtx_;
+        std::vector<uint64_t> counts_; // per bucket, the last one is +Inf
+        double sum_ = 0.0;
+    };
+
+    // 100 us .. ~0.4 s
+    static std::vector<double> latency_buckets()
+    {
+        std::vector<double> bounds;
+        for (double b = 1e-4; b < 0.5; b *= 2)
+        {
+            bounds.push_back(b);
+        }
+        return bounds;
+    }
+
+    Counter &counter(const std::string &name, const std::string &help, const std::string &labels = "")
+    {
+        return get<Counter>(name, help, "counter", labels, [] { return std::make_unique<Counter>(); });
+    }
+    Gauge &gauge(const std::string &name, const std::string &help, const std::string &labels = "")
+    {
+        return get<Gauge>(name, help, "gauge", labels, [] { return std::make_unique<Gauge>(); });
+    }
+    Histogram &histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds,
+                         const std::string &labels = "")
+    {
+        return get<Histogram>(name, help, "histogram", labels, [&] { return std::make_unique<Histogram>(bounds); });
+    }
+
+    // text exposition format 0.0.4
+    std::string render() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::ostringstream os;
+        os.precision(9);
+        for (const auto &family : families_)
+        {
+            os << "# HELP " << family.first << " " << family.second.help << "\n";
+            os << "# TYPE " << family.first << " " << family.second.type << "\n";
+            for (const auto &metric : family.second.metrics)
+            {
+                metric.second->write(os, family.first, metric.first);
+            }
+        }
+        return os.str();
+    }
+
+  private:
+    struct Family
+    {
+        std::string help, type;
+        std::map<std::string, std::unique_ptr<Metric>> metrics; // by labels
+    };
+
+    static std::string braces(const std::string &labels)
+    {
+        return labels.empty() ? "" : "{" + labels + "}";
+    }
+
+    template <class M, class Make>
+    M &get(const std::string &name, const std::string &help, const std::string &type, const std::string &labels,
+           Make make)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        Family &family = families_[name];
+        if (family.type.empty())
+        {
+            family.help = help;
+            family.type = type;
+        }
+        else if (family.type != type)
+        {
+            throw std::runtime_error("metrics: " + name + " is already registered as a " + family.type);
+        }
+        auto &metric = family.metrics[labels];
+        if (!metric)
+        {
+            metric = make();
+        }
+        return static_cast<M &>(*metric);
+    }
+
+    mutable std::mutex mtx_;
+    std::map<std::string, Family> families_;
+};
+
+// Serves MetricsRegistry::render() to every HTTP request on 127.0.0.1:port, or on the UNIX socket socket_path if that
+// is not empty, from its own thread. Only loopback/local connections are possible, there is no authentication.
+class MetricsExporter
+{
+  public:
+    // throws std::runtime_error if the socket cannot be bound
+    MetricsExporter(std::shared_ptr<const MetricsRegistry> registry, int port, const std::string &socket_path = "");
+    ~MetricsExporter();
+
+    // the bound TCP port (useful with port 0), -1 for a UNIX socket
+    int port() const
+    {
+        return port_;
+    }
+    uint64_t requests() const
+    {
+        return requests_.load();
+    }
+
+  private:
+    void serve();
+
+    std::shared_ptr<const MetricsRegistry> registry_;
+    std::string socket_path_;
+    int fd_ = -1;
+    int port_ = -1;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> requests_{0};
+    std::thread thread_;
+};
+
+} // namespace casadi_mpc_template
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <nmpc_motion_planner/nmpc_prob.hpp>
+
+namespace casadi_mpc_template
+{
+
+// UR20 on a holonomic planar base. q = [x, y, theta, q_arm(6)] with the base pose in the world frame, the state is
+// x = [q; q_dot] (18) and the input the 9 accelerations, so the dynamics stay the decoupled double integrator of
+// MotionPlanningProb. The arm chain is evaluated as before and only composed with the base transform at the end: the
+// base states enter the cost and the collision constraints through one rigid transform, which keeps their Jacobian and
+// Hessian blocks small and leaves the stage-wise sparsity of the NLP unchanged.
+class MobileManipulatorProb : public MotionPlanningProb
+{
+  public:
+    MobileManipulatorProb(DynamicsType dynamics_type, int horizon_length, double dt);
+
+    // arm limits of ur20_joint_limits() plus base_vel_limit, inputs +-accel_limit (arm) and +-base_accel_limit (base)
+    void set_ur20_bounds(double accel_limit = 5.0) override;
+
+    // world to frame i transforms, the base transform composed with the arm chain of MotionPlanningProb
+    std::vector<casadi::MX> joint_transforms(casadi::MX q) override;
+    // of the arm joints only, the base does not change the manipulability of the arm
+    casadi::MX singularity_measures(casadi::MX q) override;
+
+    // world to arm base transform of the base pose [x, y, theta]
+    casadi::MX base_transform(casadi::MX base_pose) const;
+
+    static constexpr int base_dofs = 3;
+
+    // arm base in the mobile base frame
+    Eigen::Vector3d mount_offset = Eigen::Vector3d::Zero();
+    // [vx, vy, omega] and their accelerations, symmetric
+    Eigen::Vector3d base_vel_limit = Eigen::Vector3d(1.0, 1.0, 1.0);
+    Eigen::Vector3d base_accel_limit = Eigen::Vector3d(1.0, 1.0, 2.0);
+};
+
+} // namespace casadi_mpc_template
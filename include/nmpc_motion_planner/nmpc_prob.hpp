@@ -17,6 +17,14 @@ namespace casadi_mpc_template
 class MotionPlanningProb : public Problem
 {
   public:
+    struct JointLimits
+    {
+        Eigen::VectorXd pos_lower, pos_upper, vel_lower, vel_upper;
+    };
+    static JointLimits ur20_joint_limits();
+    // UR20 joint position/velocity limits as state bounds and +-accel_limit as input bounds on every stage
+    virtual void set_ur20_bounds(double accel_limit = 5.0);
+
     MotionPlanningProb(DynamicsType dynamics_type, int state_dim, int control_dim, int horizon_length, double dt);
     virtual ~MotionPlanningProb() = default;
 
@@ -25,11 +33,35 @@ class MotionPlanningProb : public Problem
     // virtual casadi::MX terminal_cost(casadi::MX x) override;
     Eigen::VectorXd discretized_dynamics(double dt, Eigen::VectorXd x, Eigen::VectorXd u);
     casadi::MX forward_kinematics(casadi::MX q);
+    // base to frame i transforms of the DH chain, i = 1..6
+    virtual std::vector<casadi::MX> joint_transforms(casadi::MX q);
+    // 3 x K points along the links used as collision spheres of radius link_radius
+    casadi::MX link_points(casadi::MX q);
+    // [position(3); quaternion(4)] of the end effector, quaternion as w, x, y, z
+    casadi::MX end_effector_pose(casadi::MX q);
+    // closed-form UR singularity measures [elbow, wrist, shoulder], the Jacobian determinant is their product up to a
+    // constant, each one is zero at the respective singularity
+    virtual casadi::MX singularity_measures(casadi::MX q);
+    // static spherical obstacles, add them before calling add_collision_constraints()
+    void add_sphere_obstacle(const Eigen::Vector3d &center, double radius);
+    // one inequality per link point/obstacle pair, or with rho > 0 one KS aggregated inequality per stage
+    void add_collision_constraints(double rho = 0.0);
+    casadi::MX collision_distances(casadi::MX q);
     casadi::MX compute_trans_error(casadi::MX x_pose);
     casadi::MX compute_ori_error(casadi::MX x_quat);
     casadi::DM Q_trans, Q_ori, Q_vel, R;
 
-    casadi::DM x_pose_ref, x_quat_ref;
+    // optional singularity avoidance cost sum_i w_i / (m_i^2 + singularity_eps) on singularity_measures()
+    double w_elbow = 0.0, w_wrist = 0.0, w_shoulder = 0.0;
+    double singularity_eps = 0.05;
+
+    double link_radius = 0.08;
+    std::vector<std::pair<Eigen::Vector3d, double>> obstacles;
+
+    // parameter() = [x_pose_ref(3); x_quat_ref(4)] (quaternion as w, x, y, z)
+    static Eigen::VectorXd reference_parameter(const Eigen::Vector3d &position, const Eigen::Quaterniond &orientation);
+    casadi::MX x_pose_ref() const;
+    casadi::MX x_quat_ref() const;
     casadi::MX x_pose, x_quat;
 };
 
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <nmpc_motion_planner/nmpc_prob.hpp>
+#include <nmpc_motion_planner/solver_profile.hpp>
+
+namespace casadi_mpc_template
+{
+
+// Declarative description of the planner OCP, loaded from a YAML file (the subset of read_key_values):
+//
+//   horizon: 10
+//   dt: 0.01
+//   integrator: rk4              # euler, modified_euler, rk4
+//   condensing_block: 1
+//   input_control_points: 0
+//   cost:
+//     position: 800              # weights of MotionPlanningProb
+//     orientation: 500
+//     velocity: 10
+//     input: 0.01
+//     elbow: 0.0                 # singularity avoidance
+//     wrist: 0.0
+//     shoulder: 0.0
+//     singularity_eps: 0.05
+//   bounds:
+//     position_lower: [...]      # 6 values each, UR20 limits if omitted
+//     position_upper: [...]
+//     velocity_lower: [...]
+//     velocity_upper: [...]
+//     acceleration: 5.0
+//   constraints:
+//     obstacles: [x, y, z, radius, ...]
+//     link_radius: 0.08
+//     aggregate_rho: 0.0
+//   solver:
+//     backend: ipopt             # ipopt, qpoases, hpipm, osqp
+//     rti: false
+//     options:                   # merged into the backend defaults
+//       max_iter: 5
+//
+// The defaults are the hard coded problem of nmpc_planner. hash() is taken over the canonical form, so the same problem
+// gives the same hash independent of formatting, comments and key order.
+struct ProblemSpec
+{
+    size_t horizon = 10;
+    double dt = 0.01;
+    Problem::DynamicsType integrator = Problem::DynamicsType::ContinuesRK4;
+    size_t condensing_block = 1;
+    size_t input_control_points = 0;
+
+    double w_position = 800.0, w_orientation = 500.0, w_velocity = 10.0, w_input = 0.01;
+    double w_elbow = 0.0, w_wrist = 0.0, w_shoulder = 0.0;
+    double singularity_eps = 0.05;
+
+    Eigen::VectorXd position_lower, position_upper, velocity_lower, velocity_upper;
+    double accel_limit = 5.0;
+
+    std::vector<double> obstacles;
+    double link_radius = 0.08;
+    double collision_rho = 0.0;
+
+    std::string backend = "ipopt";
+    bool rti = false;
+    casadi::Dict solver_options; // flat keys, see flatten_options()
+
+    ProblemSpec();
+
+    // throws std::runtime_error on unknown keys and malformed values
+    static ProblemSpec load(const std::string &path);
+    // from the text of a spec file, e.g. canonical() stored in a FailurePoint
+    static ProblemSpec parse(const std::string &text, const std::string &source = "problem description");
+    void save(const std::string &path) const;
+
+    // one "key: value" line per field, sorted
+    std::string canonical() const;
+    // FNV-1a of canonical() and the CasADi version, as 16 hex digits
+    std::string hash() const;
+
+    std::shared_ptr<MotionPlanningProb> make_problem() const;
+    // nlpsol plugin and options of the backend with rti and solver_options applied
+    SolverProfile solver_profile() const;
+    // <directory>/nmpc_solver_<hash>.casadi, creates the directory
+    std::string solver_cache_file(const std::string &directory) const;
+};
+
+} // namespace casadi_mpc_template
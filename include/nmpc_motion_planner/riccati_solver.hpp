@@ -0,0 +1,496 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace casadi_mpc_template
+{
+
+// Native solver for the equality constrained LQ problems that appear as SQP/RTI subproblems:
+//
+//   min  sum_k 0.5 x_k' Q_k x_k + 0.5 u_k' R_k u_k + u_k' S_k x_k + q_k' x_k + r_k' u_k
+//        + 0.5 x_N' Q_N x_N + q_N' x_N
+//   s.t. x_{k+1} = A_k x_k + B_k u_k + c_k,  x_0 given
+//
+// factorize() runs the backward Riccati recursion, solve(x0) the forward rollout of the feedback law.
+
+template <class MatX, class MatU, class MatUX, class MatXU, class VecX, class VecU> struct LQStageT
+{
+    MatX A, Q;
+    MatXU B;
+    MatU R;
+    MatUX S;
+    VecX c, q;
+    VecU r;
+
+    // feedback u = K x + k, filled by factorize()
+    MatUX K;
+    VecU k;
+};
+
+using LQStage = LQStageT<Eigen::MatrixXd, Eigen::MatrixXd, Eigen::MatrixXd, Eigen::MatrixXd, Eigen::VectorXd,
+                         Eigen::VectorXd>;
+
+// One backward Riccati step, P/p hold the cost-to-go of x_{k+1} on entry and of x_k on return.
+template <class Stage, class MatP, class VecP> inline void riccati_backward_step(Stage &s, MatP &P, VecP &p)
+{
+    const auto PA = (P * s.A).eval();
+    const auto PB = (P * s.B).eval();
+    const auto h = (P * s.c + p).eval();
+
+    const auto R_bar = (s.R + s.B.transpose() * PB).eval();
+    const auto S_bar = (s.S + s.B.transpose() * PA).eval();
+    const auto r_bar = (s.r + s.B.transpose() * h).eval();
+
+    const auto llt = R_bar.llt();
+    s.K = -llt.solve(S_bar);
+    s.k = -llt.solve(r_bar);
+
+    P = s.Q + s.A.transpose() * PA + S_bar.transpose() * s.K;
+    p = s.q + s.A.transpose() * h + S_bar.transpose() * s.k;
+    P = 0.5 * (P + P.transpose()).eval();
+}
+
+// Backward step with an additional linear terminal cost mu' x_b at the end of the segment: the linear part of the
+// cost-to-go is p + Pi mu and the feedback u = K x + k + K_mu mu. Pi holds the sensitivity for x_{k+1} on entry and for
+// x_k on return.
+template <class Stage, class MatP, class VecP, class MatPi, class MatKmu>
+inline void riccati_backward_step(Stage &s, MatP &P, VecP &p, MatPi &Pi, MatKmu &K_mu)
+{
+    const auto PA = (P * s.A).eval();
+    const auto PB = (P * s.B).eval();
+    const auto h = (P * s.c + p).eval();
+
+    const auto R_bar = (s.R + s.B.transpose() * PB).eval();
+    const auto S_bar = (s.S + s.B.transpose() * PA).eval();
+    const auto r_bar = (s.r + s.B.transpose() * h).eval();
+
+    const auto llt = R_bar.llt();
+    s.K = -llt.solve(S_bar);
+    s.k = -llt.solve(r_bar);
+    K_mu = -llt.solve(s.B.transpose() * Pi);
+
+    P = s.Q + s.A.transpose() * PA + S_bar.transpose() * s.K;
+    p = s.q + s.A.transpose() * h + S_bar.transpose() * s.k;
+    P = 0.5 * (P + P.transpose()).eval();
+    Pi = (s.A.transpose() * Pi + S_bar.transpose() * K_mu).eval();
+}
+
+// Runtime sized solver, dimensions and horizon are set at construction.
+class RiccatiSolver
+{
+  public:
+    RiccatiSolver(size_t nx, size_t nu, size_t horizon) : nx_(nx), nu_(nu), N_(horizon)
+    {
+        LQStage stage;
+        stage.A = Eigen::MatrixXd::Identity(nx, nx);
+        stage.Q = Eigen::MatrixXd::Zero(nx, nx);
+        stage.B = Eigen::MatrixXd::Zero(nx, nu);
+        stage.R = Eigen::MatrixXd::Identity(nu, nu);
+        stage.S = Eigen::MatrixXd::Zero(nu, nx);
+        stage.c = Eigen::VectorXd::Zero(nx);
+        stage.q = Eigen::VectorXd::Zero(nx);
+        stage.r = Eigen::VectorXd::Zero(nu);
+        stage.K = Eigen::MatrixXd::Zero(nu, nx);
+        stage.k = Eigen::VectorXd::Zero(nu);
+        stages_ = std::vector<LQStage>(N_, stage);
+
+        Q_N = Eigen::MatrixXd::Zero(nx, nx);
+        q_N = Eigen::VectorXd::Zero(nx);
+        x_ = std::vector<Eigen::VectorXd>(N_ + 1, Eigen::VectorXd::Zero(nx));
+        u_ = std::vector<Eigen::VectorXd>(N_, Eigen::VectorXd::Zero(nu));
+    }
+
+    LQStage &stage(size_t k)
+    {
+        return stages_[k];
+    }
+
+    void factorize()
+    {
+        P_ = Q_N;
+        p_ = q_N;
+        for (size_t k = N_; k-- > 0;)
+        {
+            riccati_backward_step(stages_[k], P_, p_);
+        }
+    }
+
+    void solve(const Eigen::VectorXd &x0)
+    {
+        x_[0] = x0;
+        for (size_t k = 0; k < N_; k++)
+        {
+            const auto &s = stages_[k];
+            u_[k] = s.K * x_[k] + s.k;
+            x_[k + 1] = s.A * x_[k] + s.B * u_[k] + s.c;
+        }
+    }
+
+    const std::vector<Eigen::VectorXd> &x() const
+    {
+        return x_;
+    }
+    const std::vector<Eigen::VectorXd> &u() const
+    {
+        return u_;
+    }
+    size_t nx() const
+    {
+        return nx_;
+    }
+    size_t nu() const
+    {
+        return nu_;
+    }
+    size_t horizon() const
+    {
+        return N_;
+    }
+
+    Eigen::MatrixXd Q_N;
+    Eigen::VectorXd q_N;
+
+  private:
+    const size_t nx_;
+    const size_t nu_;
+    const size_t N_;
+
+    std::vector<LQStage> stages_;
+    Eigen::MatrixXd P_;
+    Eigen::VectorXd p_;
+    std::vector<Eigen::VectorXd> x_;
+    std::vector<Eigen::VectorXd> u_;
+};
+
+// Parallel-in-time variant for long horizons. The horizon is split into segments that are factorized concurrently,
+// each one with a zero terminal Hessian and an unknown linear terminal cost mu_j' x (mu_j is the gradient of the true
+// cost-to-go at the segment end). Every segment also yields the affine map x_end = Phi x_start + Gamma mu + phi of its
+// closed loop. A serial recursion over the segments then resolves mu_j = M_j x_start + m_j and the true cost-to-go,
+// so the sequential part is one nx x nx solve per segment instead of one Riccati step per stage. A segment with mu
+// costs about twice the serial recursion, so this pays off with three or more cores. Segments 1.. are factorized by
+// workers that the solver starts once and keeps for its lifetime, segment 0 by the thread calling factorize().
+class ParallelRiccatiSolver
+{
+  public:
+    ParallelRiccatiSolver(size_t nx, size_t nu, size_t horizon,
+                          size_t num_segments = std::thread::hardware_concurrency())
+        : serial_(nx, nu, horizon), nx_(nx), nu_(nu), N_(horizon)
+    {
+        num_segments = std::max<size_t>(1, std::min(num_segments, horizon));
+        for (size_t j = 0; j <= num_segments; j++)
+        {
+            bounds_.push_back(j * horizon / num_segments);
+        }
+        segments_ = std::vector<Segment>(num_segments);
+        for (auto &seg : segments_)
+        {
+            seg.P = Eigen::MatrixXd::Zero(nx, nx);
+            seg.p = Eigen::VectorXd::Zero(nx);
+            seg.Pi = Eigen::MatrixXd::Zero(nx, nx);
+            seg.Phi = Eigen::MatrixXd::Identity(nx, nx);
+            seg.Gamma = Eigen::MatrixXd::Zero(nx, nx);
+            seg.phi = Eigen::VectorXd::Zero(nx);
+            seg.M = Eigen::MatrixXd::Zero(nx, nx);
+            seg.m = Eigen::VectorXd::Zero(nx);
+        }
+        K_mu_ = std::vector<Eigen::MatrixXd>(N_, Eigen::MatrixXd::Zero(nu, nx));
+        x_ = std::vector<Eigen::VectorXd>(N_ + 1, Eigen::VectorXd::Zero(nx));
+        u_ = std::vector<Eigen::VectorXd>(N_, Eigen::VectorXd::Zero(nu));
+        Q_N = Eigen::MatrixXd::Zero(nx, nx);
+        q_N = Eigen::VectorXd::Zero(nx);
+        for (size_t j = 1; j < segments_.size(); j++)
+        {
+            workers_.emplace_back(&ParallelRiccatiSolver::run_worker, this, j);
+        }
+    }
+
+    ~ParallelRiccatiSolver()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        start_cv_.notify_all();
+        for (auto &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    ParallelRiccatiSolver(const ParallelRiccatiSolver &) = delete;
+    ParallelRiccatiSolver &operator=(const ParallelRiccatiSolver &) = delete;
+
+    LQStage &stage(size_t k)
+    {
+        return serial_.stage(k);
+    }
+
+    void factorize()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            pending_ = workers_.size();
+            generation_++;
+        }
+        start_cv_.notify_all();
+        factorize_segment(0);
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            done_cv_.wait(lock, [this] { return pending_ == 0; });
+        }
+
+        // the last segment has the true terminal cost; going backwards, mu_j = P_b x_b + p_b with the cost-to-go of
+        // the next segment start and x_b = Phi x_a + Gamma mu_j + phi gives mu_j = M_j x_a + m_j
+        for (size_t j = segments_.size() - 1; j-- > 0;)
+        {
+            auto &seg = segments_[j];
+            const auto &next = segments_[j + 1];
+            Eigen::MatrixXd I_PG = Eigen::MatrixXd::Identity(nx_, nx_) - next.P * seg.Gamma;
+            auto lu = I_PG.partialPivLu();
+            seg.M = lu.solve(next.P * seg.Phi);
+            seg.m = lu.solve(next.P * seg.phi + next.p);
+            seg.P = seg.P + seg.Pi * seg.M;
+            seg.P = 0.5 * (seg.P + seg.P.transpose()).eval();
+            seg.p = seg.p + seg.Pi * seg.m;
+        }
+    }
+
+    void solve(const Eigen::VectorXd &x0)
+    {
+        x_[0] = x0;
+        for (size_t j = 0; j < segments_.size(); j++)
+        {
+            const auto &seg = segments_[j];
+            Eigen::VectorXd mu = seg.M * x_[bounds_[j]] + seg.m;
+            for (size_t k = bounds_[j]; k < bounds_[j + 1]; k++)
+            {
+                const auto &s = serial_.stage(k);
+                u_[k] = s.K * x_[k] + s.k + K_mu_[k] * mu;
+                x_[k + 1] = s.A * x_[k] + s.B * u_[k] + s.c;
+            }
+        }
+    }
+
+    const std::vector<Eigen::VectorXd> &x() const
+    {
+        return x_;
+    }
+    const std::vector<Eigen::VectorXd> &u() const
+    {
+        return u_;
+    }
+    size_t nx() const
+    {
+        return nx_;
+    }
+    size_t nu() const
+    {
+        return nu_;
+    }
+    size_t horizon() const
+    {
+        return N_;
+    }
+    size_t num_segments() const
+    {
+        return segments_.size();
+    }
+
+    Eigen::MatrixXd Q_N;
+    Eigen::VectorXd q_N;
+
+  private:
+    struct Segment
+    {
+        // cost-to-go at the segment start: P x + p + Pi mu before, the true one after the coupling recursion
+        Eigen::MatrixXd P, Pi;
+        Eigen::VectorXd p;
+        // closed loop map of the segment, x_end = Phi x_start + Gamma mu + phi
+        Eigen::MatrixXd Phi, Gamma;
+        Eigen::VectorXd phi;
+        // mu = M x_start + m
+        Eigen::MatrixXd M;
+        Eigen::VectorXd m;
+    };
+
+    // factorizes segment j for every generation until the solver is destroyed
+    void run_worker(size_t j)
+    {
+        size_t generation = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                start_cv_.wait(lock, [&] { return stop_ || generation_ != generation; });
+                if (stop_)
+                {
+                    return;
+                }
+                generation = generation_;
+            }
+            factorize_segment(j);
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (--pending_ == 0)
+            {
+                done_cv_.notify_one();
+            }
+        }
+    }
+
+    void factorize_segment(size_t j)
+    {
+        auto &seg = segments_[j];
+        const bool last = j + 1 == segments_.size();
+        if (last)
+        {
+            // plain Riccati recursion, K_mu stays zero and the closed loop map is not needed
+            seg.P = Q_N;
+            seg.p = q_N;
+            for (size_t k = bounds_[j + 1]; k-- > bounds_[j];)
+            {
+                riccati_backward_step(serial_.stage(k), seg.P, seg.p);
+            }
+            return;
+        }
+
+        seg.P.setZero();
+        seg.p.setZero();
+        seg.Pi.setIdentity();
+        for (size_t k = bounds_[j + 1]; k-- > bounds_[j];)
+        {
+            riccati_backward_step(serial_.stage(k), seg.P, seg.p, seg.Pi, K_mu_[k]);
+        }
+
+        seg.Phi.setIdentity();
+        seg.Gamma.setZero();
+        seg.phi.setZero();
+        for (size_t k = bounds_[j]; k < bounds_[j + 1]; k++)
+        {
+            const auto &s = serial_.stage(k);
+            const Eigen::MatrixXd A_cl = s.A + s.B * s.K;
+            seg.Phi = (A_cl * seg.Phi).eval();
+            seg.Gamma = (A_cl * seg.Gamma + s.B * K_mu_[k]).eval();
+            seg.phi = (A_cl * seg.phi + s.B * s.k + s.c).eval();
+        }
+    }
+
+    // only used as stage storage
+    RiccatiSolver serial_;
+    const size_t nx_;
+    const size_t nu_;
+    const size_t N_;
+
+    std::vector<size_t> bounds_;
+    std::vector<Segment> segments_;
+    std::vector<Eigen::MatrixXd> K_mu_;
+    std::vector<Eigen::VectorXd> x_;
+    std::vector<Eigen::VectorXd> u_;
+
+    // worker j factorizes segment j once per generation, the last one to finish wakes factorize()
+    std::mutex mtx_;
+    std::condition_variable start_cv_, done_cv_;
+    size_t generation_ = 0;
+    size_t pending_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+};
+
+// Same solver with dimensions and horizon as template parameters (e.g. the UR20 problem: NX = 12, NU = 6).
+// Stage data are fixed size Eigen blocks stored contiguously in one std::array of stages and the stage loops are
+// expanded at compile time, so there is no heap allocation and no loop/size bookkeeping in the recursion.
+template <int NX, int NU, int N> class FixedRiccatiSolver
+{
+  public:
+    using VecX = Eigen::Matrix<double, NX, 1>;
+    using VecU = Eigen::Matrix<double, NU, 1>;
+    using MatX = Eigen::Matrix<double, NX, NX>;
+    using MatU = Eigen::Matrix<double, NU, NU>;
+    using Stage = LQStageT<MatX, MatU, Eigen::Matrix<double, NU, NX>, Eigen::Matrix<double, NX, NU>, VecX, VecU>;
+
+    static constexpr int nx = NX;
+    static constexpr int nu = NU;
+    static constexpr int horizon = N;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    FixedRiccatiSolver()
+    {
+        for (auto &stage : stages_)
+        {
+            stage.A.setIdentity();
+            stage.Q.setZero();
+            stage.B.setZero();
+            stage.R.setIdentity();
+            stage.S.setZero();
+            stage.c.setZero();
+            stage.q.setZero();
+            stage.r.setZero();
+            stage.K.setZero();
+            stage.k.setZero();
+        }
+        Q_N.setZero();
+        q_N.setZero();
+    }
+
+    Stage &stage(size_t k)
+    {
+        return stages_[k];
+    }
+
+    void factorize()
+    {
+        P_ = Q_N;
+        p_ = q_N;
+        backward(std::make_index_sequence<N>{});
+    }
+
+    void solve(const VecX &x0)
+    {
+        x_[0] = x0;
+        forward(std::make_index_sequence<N>{});
+    }
+
+    const std::array<VecX, N + 1> &x() const
+    {
+        return x_;
+    }
+    const std::array<VecU, N> &u() const
+    {
+        return u_;
+    }
+
+    MatX Q_N;
+    VecX q_N;
+
+  private:
+    template <size_t... I> void backward(std::index_sequence<I...>)
+    {
+        (riccati_backward_step(std::get<N - 1 - I>(stages_), P_, p_), ...);
+    }
+
+    template <size_t K> void forward_stage()
+    {
+        const auto &s = std::get<K>(stages_);
+        std::get<K>(u_) = s.K * std::get<K>(x_) + s.k;
+        std::get<K + 1>(x_) = s.A * std::get<K>(x_) + s.B * std::get<K>(u_) + s.c;
+    }
+
+    template <size_t... I> void forward(std::index_sequence<I...>)
+    {
+        (forward_stage<I>(), ...);
+    }
+
+    std::array<Stage, N> stages_;
+    MatX P_;
+    VecX p_;
+    std::array<VecX, N + 1> x_;
+    std::array<VecU, N> u_;
+};
+
+} // namespace casadi_mpc_template
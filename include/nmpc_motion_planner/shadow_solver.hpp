@@ -0,0 +1,61 @@
+#pragma once
+
+#include <nmpc_motion_planner/casadi_mpc_template.hpp>
+#include <nmpc_motion_planner/solve_statistics.hpp>
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace casadi_mpc_template
+{
+
+// Shadow evaluation of a candidate solver configuration against the production solver. The control loop submits
+// every tick (state, reference, the production input and its solve time/iterations), a background thread, optionally
+// pinned to a spare CPU, solves the same problem with the candidate MPC and appends one CSV row per evaluated tick.
+// The candidate never commands anything, and submit() never waits for it: a tick submitted while the previous one is
+// still being solved replaces the pending one and is counted as dropped.
+class ShadowSolver
+{
+  public:
+    struct Sample
+    {
+        double stamp = 0.0;
+        Eigen::VectorXd x0, p;
+        Eigen::VectorXd u; // production input
+        double solve_time = 0.0;
+        int iterations = 0;
+    };
+
+    // throws std::runtime_error if log_file cannot be written
+    ShadowSolver(std::unique_ptr<MPC> candidate, const std::string &log_file, int cpu = -1);
+    ~ShadowSolver();
+
+    void submit(const Sample &sample);
+
+    // production vs candidate solve time/iterations, input difference and dropped ticks
+    std::string summary() const;
+    size_t dropped() const;
+
+  private:
+    void worker();
+
+    std::unique_ptr<MPC> candidate_;
+    std::ofstream log_;
+
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    bool has_sample_ = false;
+    bool stop_ = false;
+    Sample sample_;
+    size_t dropped_ = 0;
+
+    SolveStatistics production_stats_, candidate_stats_;
+    double max_input_diff_ = 0.0;
+    double sum_input_diff_ = 0.0;
+    size_t evaluated_ = 0;
+    std::thread thread_;
+};
+
+} // namespace casadi_mpc_template
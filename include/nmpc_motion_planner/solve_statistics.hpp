@@ -0,0 +1,93 @@
+#pragma once
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace casadi_mpc_template
+{
+
+// Rolling window of solve times and iteration counts for tail statistics (p50/p95/p99/max).
+class SolveStatistics
+{
+  public:
+    explicit SolveStatistics(size_t window = 1000) : window_(window)
+    {
+    }
+
+    void add(double solve_time, int iterations)
+    {
+        times_.push_back(solve_time);
+        iterations_.push_back(iterations);
+        if (times_.size() > window_)
+        {
+            times_.pop_front();
+            iterations_.pop_front();
+        }
+        count_++;
+    }
+
+    // empties the window, count() keeps counting
+    void clear()
+    {
+        times_.clear();
+        iterations_.clear();
+    }
+
+    // q in [0, 1], 0 if empty
+    double time_quantile(double q) const
+    {
+        return quantile(times_, q);
+    }
+    double iteration_quantile(double q) const
+    {
+        return quantile(iterations_, q);
+    }
+    double mean_time() const
+    {
+        double sum = 0;
+        for (double t : times_)
+        {
+            sum += t;
+        }
+        return times_.empty() ? 0.0 : sum / times_.size();
+    }
+
+    size_t size() const
+    {
+        return times_.size();
+    }
+    size_t count() const
+    {
+        return count_;
+    }
+
+    std::string summary() const
+    {
+        return "solve time p50 " + std::to_string(time_quantile(0.5)) + " p95 " + std::to_string(time_quantile(0.95)) +
+               " p99 " + std::to_string(time_quantile(0.99)) + " max " + std::to_string(time_quantile(1.0)) +
+               " | iterations p50 " + std::to_string(iteration_quantile(0.5)) + " p95 " +
+               std::to_string(iteration_quantile(0.95)) + " p99 " + std::to_string(iteration_quantile(0.99)) +
+               " max " + std::to_string(iteration_quantile(1.0));
+    }
+
+  private:
+    template <class T> static double quantile(const std::deque<T> &values, double q)
+    {
+        if (values.empty())
+        {
+            return 0.0;
+        }
+        std::vector<T> sorted(values.begin(), values.end());
+        size_t i = std::min(sorted.size() - 1, static_cast<size_t>(q * (sorted.size() - 1) + 0.5));
+        std::nth_element(sorted.begin(), sorted.begin() + i, sorted.end());
+        return sorted[i];
+    }
+
+    const size_t window_;
+    std::deque<double> times_;
+    std::deque<int> iterations_;
+    size_t count_ = 0;
+};
+
+} // namespace casadi_mpc_template
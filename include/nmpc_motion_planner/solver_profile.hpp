@@ -0,0 +1,233 @@
+#pragma once
+#include <casadi/casadi.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace casadi_mpc_template
+{
+
+// nlpsol plugin name and options, stored as a plain text file with one "key: value" per line (see read_key_values).
+// Nested option dictionaries are flattened to dotted keys (qpsol_options.osqp.eps_abs: 1e-05) when written.
+struct SolverProfile
+{
+    std::string solver = "ipopt";
+    casadi::Dict options;
+};
+
+// {"a": {"b": 1}} -> {"a.b": 1}
+inline casadi::Dict flatten_options(const casadi::Dict &options, const std::string &prefix = "")
+{
+    casadi::Dict flat;
+    for (const auto &kv : options)
+    {
+        if (kv.second.is_dict())
+        {
+            for (const auto &nested : flatten_options(kv.second.as_dict(), prefix + kv.first + "."))
+            {
+                flat[nested.first] = nested.second;
+            }
+        }
+        else
+        {
+            flat[prefix + kv.first] = kv.second;
+        }
+    }
+    return flat;
+}
+
+// {"a.b": 1} -> {"a": {"b": 1}}
+inline casadi::Dict nest_options(const casadi::Dict &flat)
+{
+    casadi::Dict nested, groups;
+    for (const auto &kv : flat)
+    {
+        size_t dot = kv.first.find('.');
+        if (dot == std::string::npos)
+        {
+            nested[kv.first] = kv.second;
+            continue;
+        }
+        std::string group = kv.first.substr(0, dot);
+        casadi::Dict sub = groups.count(group) ? groups[group].as_dict() : casadi::Dict();
+        sub[kv.first.substr(dot + 1)] = kv.second;
+        groups[group] = sub;
+    }
+    for (const auto &kv : groups)
+    {
+        nested[kv.first] = nest_options(kv.second.as_dict());
+    }
+    return nested;
+}
+
+inline casadi::GenericType parse_option_value(const std::string &value)
+{
+    if (value == "true" || value == "false")
+    {
+        return value == "true";
+    }
+    size_t pos = 0;
+    try
+    {
+        long long i = std::stoll(value, &pos);
+        if (pos == value.size())
+        {
+            return static_cast<casadi_int>(i);
+        }
+    }
+    catch (const std::exception &)
+    {
+    }
+    try
+    {
+        double d = std::stod(value, &pos);
+        if (pos == value.size())
+        {
+            return d;
+        }
+    }
+    catch (const std::exception &)
+    {
+    }
+    return value;
+}
+
+inline std::string format_option_value(const std::string &key, const casadi::GenericType &value)
+{
+    std::ostringstream os;
+    if (value.is_bool())
+    {
+        os << (value.as_bool() ? "true" : "false");
+    }
+    else if (value.is_int())
+    {
+        os << value.as_int();
+    }
+    else if (value.is_double())
+    {
+        // keep a decimal point or exponent, so the value is read back as a double
+        os.precision(17);
+        os << value.as_double();
+        if (os.str().find_first_of(".eE") == std::string::npos && os.str().find("inf") == std::string::npos)
+        {
+            os << ".0";
+        }
+    }
+    else if (value.is_string())
+    {
+        os << value.as_string();
+    }
+    else
+    {
+        throw std::runtime_error("solver profile: unsupported value type of option " + key);
+    }
+    return os.str();
+}
+
+// Reads the "key: value" lines of a config file (solver profiles, problem specs), a YAML subset: '#' comments, nested
+// maps by indentation ("a:" followed by indented "b: 1" gives the key "a.b") and flow lists as the raw value "[1, 2]".
+// path only names the source in the error messages.
+inline std::vector<std::pair<std::string, std::string>> read_key_values(std::istream &file, const std::string &path,
+                                                                        const std::string &what)
+{
+    auto trim = [](const std::string &s) {
+        size_t begin = s.find_first_not_of(" \t\r");
+        return begin == std::string::npos ? std::string() : s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+    };
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::vector<std::pair<size_t, std::string>> sections; // indentation and key of the open maps
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#' || trim(line).empty())
+        {
+            continue;
+        }
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            throw std::runtime_error(what + ": expected 'key: value' in " + path + ": " + line);
+        }
+        std::string key = trim(line.substr(start, colon - start));
+        std::string value = line.substr(colon + 1);
+        value = trim(value.substr(0, value.find(" #")));
+        if (value.size() >= 2 && (value[0] == '"' || value[0] == '\'') && value.back() == value[0])
+        {
+            value = value.substr(1, value.size() - 2);
+        }
+
+        while (!sections.empty() && sections.back().first >= start)
+        {
+            sections.pop_back();
+        }
+        std::string prefix;
+        for (auto &section : sections)
+        {
+            prefix += section.second + ".";
+        }
+        if (value.empty())
+        {
+            sections.push_back({start, key});
+            continue;
+        }
+        entries.push_back({prefix + key, value});
+    }
+    return entries;
+}
+
+inline std::vector<std::pair<std::string, std::string>> read_key_values(const std::string &path,
+                                                                        const std::string &what)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error(what + ": cannot open " + path);
+    }
+    return read_key_values(file, path, what);
+}
+
+inline SolverProfile load_solver_profile(const std::string &path)
+{
+    SolverProfile profile;
+    casadi::Dict flat;
+    for (const auto &kv : read_key_values(path, "solver profile"))
+    {
+        if (kv.first == "solver")
+        {
+            profile.solver = kv.second;
+        }
+        else
+        {
+            flat[kv.first] = parse_option_value(kv.second);
+        }
+    }
+    profile.options = nest_options(flat);
+    return profile;
+}
+
+inline void save_solver_profile(const std::string &path, const SolverProfile &profile, const std::string &comment = "")
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("solver profile: cannot write " + path);
+    }
+    std::istringstream comment_lines(comment);
+    std::string line;
+    while (std::getline(comment_lines, line))
+    {
+        file << "# " << line << "\n";
+    }
+    file << "solver: " << profile.solver << "\n";
+    for (const auto &kv : flatten_options(profile.options))
+    {
+        file << kv.first << ": " << format_option_value(kv.first, kv.second) << "\n";
+    }
+}
+
+} // namespace casadi_mpc_template
@@ -0,0 +1,46 @@
+#pragma once
+#include <pthread.h>
+#include <sched.h>
+
+#include <thread>
+
+namespace casadi_mpc_template
+{
+
+// Pin a thread to a single CPU, cpu < 0 leaves the affinity unchanged. Returns false if the CPU cannot be used.
+inline bool set_thread_affinity(pthread_t thread, int cpu)
+{
+    if (cpu < 0)
+    {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+inline bool set_thread_affinity(std::thread &thread, int cpu)
+{
+    return set_thread_affinity(thread.native_handle(), cpu);
+}
+
+inline bool set_current_thread_affinity(int cpu)
+{
+    return set_thread_affinity(pthread_self(), cpu);
+}
+
+// SCHED_FIFO with the given priority (1-99), priority <= 0 leaves the scheduling unchanged. Needs CAP_SYS_NICE or an
+// rtprio limit, returns false otherwise.
+inline bool set_thread_realtime(pthread_t thread, int priority)
+{
+    if (priority <= 0)
+    {
+        return true;
+    }
+    sched_param param{};
+    param.sched_priority = priority;
+    return pthread_setschedparam(thread, SCHED_FIFO, &param) == 0;
+}
+
+} // namespace casadi_mpc_template
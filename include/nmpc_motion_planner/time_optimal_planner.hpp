@@ -0,0 +1,77 @@
+#pragma once
+
+#include <nmpc_motion_planner/nmpc_prob.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace casadi_mpc_template
+{
+
+// Free final time point-to-point planner.
+// The duration T of the move is a decision variable (every stage lasts T / num_stages), the end effector has to reach
+// the target given by MotionPlanningProb::parameter() at rest and the cost is T plus a small input regularization.
+// Forward kinematics and joint/input bounds are taken from the MotionPlanningProb. Solves run on a background thread,
+// the result is a time parameterized reference for the tracking MPC.
+class TimeOptimalPlanner
+{
+  public:
+    struct Trajectory
+    {
+        double duration;
+        std::vector<double> time;
+        std::vector<Eigen::VectorXd> states;
+        std::vector<Eigen::VectorXd> poses; // [position(3); quaternion(4)] as MotionPlanningProb::parameter()
+
+        // end effector pose reference at time t since the start of the move, held at the target after the end
+        Eigen::VectorXd reference_parameter(double t) const;
+        Eigen::VectorXd state(double t) const;
+    };
+
+    TimeOptimalPlanner(std::shared_ptr<MotionPlanningProb> prob, size_t num_stages = 30, double max_duration = 5.0,
+                       casadi::Dict config = default_config());
+    ~TimeOptimalPlanner();
+
+    static casadi::Dict default_config()
+    {
+        casadi::Dict config = {{"ipopt.sb", "yes"},
+                               {"ipopt.print_level", 0},
+                               {"print_time", false},
+                               {"ipopt.max_iter", 500},
+                               {"expand", true}};
+        return config;
+    }
+
+    // blocking solve, returns nullptr if no feasible move was found; not to be mixed with request()
+    std::shared_ptr<const Trajectory> plan(const Eigen::VectorXd &x0, const Eigen::VectorXd &p);
+
+    // queue a solve on the background thread, a pending request that has not been started is replaced;
+    // returns the request id
+    size_t request(const Eigen::VectorXd &x0, const Eigen::VectorXd &p);
+
+    // latest finished trajectory (nullptr until the first one succeeded) and the id of the request it belongs to
+    std::shared_ptr<const Trajectory> latest() const;
+    size_t latest_id() const;
+
+  private:
+    void worker();
+
+    std::shared_ptr<MotionPlanningProb> prob_;
+    const size_t N_;
+    casadi::Function solver_;
+    casadi::Function pose_fn_;
+    std::vector<double> lbw_, ubw_, lbg_, ubg_;
+
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    bool has_request_ = false;
+    bool stop_ = false;
+    size_t request_id_ = 0;
+    size_t latest_id_ = 0;
+    Eigen::VectorXd req_x0_, req_p_;
+    std::shared_ptr<const Trajectory> latest_;
+    std::thread thread_;
+};
+
+} // namespace casadi_mpc_template
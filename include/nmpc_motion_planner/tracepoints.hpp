@@ -0,0 +1,41 @@
+#pragma once
+
+// Static USDT probes of the planner (provider "nmpc"), for bpftrace / perf probe on a running node, see the README.
+// With NMPC_TRACEPOINTS (set by CMake when <sys/sdt.h> is found) a probe is a nop plus an ELF note, the kernel patches
+// it only while a tracer is attached. Every probe has a semaphore that the tracer increments while it is attached, and
+// the probe arguments are only evaluated when it is set, so a probe costs a load and a branch when nobody traces.
+// Without NMPC_TRACEPOINTS the macros generate no code.
+//
+// NMPC_TRACE_SEMAPHORE(name);            once per probe at global scope of the translation unit that fires it
+// NMPC_TRACE(name, args...)              e.g. NMPC_TRACE(solve_end, tick, status, iterations)
+// if (NMPC_TRACE_ENABLED(name)) {...}    for arguments that need more than an expression
+
+#ifdef NMPC_TRACEPOINTS
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define NMPC_TRACE_SEMAPHORE(name)                                                                                     \
+    __extension__ volatile unsigned short nmpc_##name##_semaphore __attribute__((unused))                              \
+    __attribute__((section(".probes")))
+#define NMPC_TRACE_ENABLED(name) __builtin_expect(nmpc_##name##_semaphore != 0, 0)
+#define NMPC_TRACE(...) NMPC_TRACE_IF_ENABLED_(__VA_ARGS__)
+#define NMPC_TRACE_IF_ENABLED_(name, ...)                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (NMPC_TRACE_ENABLED(name))                                                                                  \
+        {                                                                                                              \
+            STAP_PROBEV(nmpc, name, ##__VA_ARGS__);                                                                    \
+        }                                                                                                              \
+    } while (0)
+#else
+#include <tuple>
+#define NMPC_TRACE_SEMAPHORE(name) static_assert(true, "")
+#define NMPC_TRACE_ENABLED(name) false
+// the arguments are named in an unevaluated operand only, so variables used just for probes stay "used"; the trailing
+// 0 keeps __VA_ARGS__ of the helper non-empty for probes without arguments
+#define NMPC_TRACE(...) NMPC_TRACE_UNUSED_(__VA_ARGS__, 0)
+#define NMPC_TRACE_UNUSED_(name, ...)                                                                                  \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        (void)sizeof(std::make_tuple(__VA_ARGS__));                                                                    \
+    } while (0)
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace casadi_mpc_template
+{
+
+// Lock-free single producer / single consumer exchange of the latest value. The writer fills write_buffer() and
+// publishes it, the reader picks up the most recently published buffer with update(); neither side ever blocks or
+// waits for the other, intermediate values the reader did not pick up are dropped.
+template <class T> class TripleBuffer
+{
+  public:
+    // writer side
+    T &write_buffer()
+    {
+        return buffers_[write_];
+    }
+    void publish()
+    {
+        write_ = middle_.exchange(static_cast<uint8_t>(write_ | dirty)) & index;
+    }
+
+    // reader side: true if a newer buffer was published since the last update(), read_buffer() then refers to it
+    bool update()
+    {
+        if (!(middle_.load(std::memory_order_acquire) & dirty))
+        {
+            return false;
+        }
+        read_ = middle_.exchange(read_) & index;
+        return true;
+    }
+    const T &read_buffer() const
+    {
+        return buffers_[read_];
+    }
+
+  private:
+    static constexpr uint8_t index = 0x3;
+    static constexpr uint8_t dirty = 0x4;
+
+    std::array<T, 3> buffers_;
+    // index of the buffer between writer and reader, with the dirty flag set when it has not been read yet
+    std::atomic<uint8_t> middle_{1};
+    uint8_t write_ = 0;
+    uint8_t read_ = 2;
+};
+
+} // namespace casadi_mpc_template
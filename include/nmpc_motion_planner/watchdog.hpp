@@ -0,0 +1,121 @@
+#pragma once
+#include <nmpc_motion_planner/thread_utils.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace casadi_mpc_template
+{
+
+// Supervises a control loop through heartbeats. Its own thread wakes up every period and, once the loop has sent a
+// first heartbeat, calls on_overrun(time since the last heartbeat) on every wake-up where that time exceeds the
+// deadline, until the heartbeats resume. The callback runs on the watchdog thread, so it must not wait on the loop.
+class Watchdog
+{
+  public:
+    using Callback = std::function<void(double)>;
+
+    Watchdog(double deadline, double period, Callback on_overrun, int cpu = -1, int priority = 0)
+        : deadline_(deadline), period_(period), on_overrun_(on_overrun)
+    {
+        thread_ = std::thread(&Watchdog::run, this);
+        affinity_ok_ = set_thread_affinity(thread_, cpu);
+        realtime_ok_ = set_thread_realtime(thread_.native_handle(), priority);
+    }
+
+    ~Watchdog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void heartbeat()
+    {
+        last_heartbeat_.store(Clock::now().time_since_epoch().count(), std::memory_order_release);
+    }
+
+    // the loop is currently overrunning its deadline
+    bool tripped() const
+    {
+        return tripped_.load();
+    }
+    // number of deadline overruns (each streak of missed heartbeats counts once)
+    size_t overruns() const
+    {
+        return overruns_.load();
+    }
+    // false if the requested CPU affinity / real-time priority could not be set
+    bool affinity_ok() const
+    {
+        return affinity_ok_;
+    }
+    bool realtime_ok() const
+    {
+        return realtime_ok_;
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    void run()
+    {
+        auto next = Clock::now();
+        const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period_));
+        while (true)
+        {
+            next += period;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                if (cv_.wait_until(lock, next, [this] { return stop_; }))
+                {
+                    return;
+                }
+            }
+
+            auto last = last_heartbeat_.load(std::memory_order_acquire);
+            if (last == 0)
+            {
+                continue; // not armed yet
+            }
+            double elapsed =
+                std::chrono::duration<double>(Clock::now() - Clock::time_point(Clock::duration(last))).count();
+            if (elapsed > deadline_)
+            {
+                if (!tripped_.exchange(true))
+                {
+                    overruns_++;
+                }
+                on_overrun_(elapsed);
+            }
+            else
+            {
+                tripped_ = false;
+            }
+        }
+    }
+
+    const double deadline_;
+    const double period_;
+    Callback on_overrun_;
+
+    std::atomic<Clock::rep> last_heartbeat_{0};
+    std::atomic<bool> tripped_{false};
+    std::atomic<size_t> overruns_{0};
+    bool affinity_ok_ = true;
+    bool realtime_ok_ = true;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace casadi_mpc_template
@@ -0,0 +1,120 @@
+#include <nmpc_motion_planner/allocation_counter.hpp>
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// per thread, so the loop thread sees its own allocations and not those of the metrics server, watchdog or ROS
+// spinner threads; constant initialized, so it needs no TLS constructor inside operator new
+thread_local uint64_t allocations = 0;
+
+void *allocate(std::size_t size)
+{
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// aligned_alloc needs a size that is a multiple of the alignment
+void *allocate_aligned(std::size_t size, std::align_val_t alignment) noexcept
+{
+    allocations++;
+    const std::size_t align = static_cast<std::size_t>(alignment);
+    return std::aligned_alloc(align, (size + align - 1) / align * align + (size ? 0 : align));
+}
+} // namespace
+
+uint64_t casadi_mpc_template::allocation_count()
+{
+    return allocations;
+}
+
+void *operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    allocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    allocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void *p = allocate_aligned(size, alignment))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocate_aligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocate_aligned(size, alignment);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
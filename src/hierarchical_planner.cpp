@@ -0,0 +1,136 @@
+#include <nmpc_motion_planner/hierarchical_planner.hpp>
+#include <nmpc_motion_planner/thread_utils.hpp>
+
+#include <chrono>
+
+using namespace casadi_mpc_template;
+
+Eigen::VectorXd HierarchicalPlanner::Plan::state(double t) const
+{
+    double s = (t - stamp) / dt;
+    if (s <= 0)
+    {
+        return states.front();
+    }
+    size_t i = static_cast<size_t>(s);
+    if (i + 1 >= states.size())
+    {
+        return states.back();
+    }
+    s -= i;
+    return (1 - s) * states[i] + s * states[i + 1];
+}
+
+HierarchicalPlanner::HierarchicalPlanner(std::unique_ptr<MPC> outer, double outer_dt, std::unique_ptr<MPC> inner,
+                                         std::shared_ptr<JointTrackingProb> inner_prob, Callbacks callbacks,
+                                         Config config)
+    : outer_(std::move(outer)), outer_dt_(outer_dt), inner_(std::move(inner)), inner_prob_(inner_prob),
+      callbacks_(callbacks), config_(config)
+{
+}
+
+HierarchicalPlanner::~HierarchicalPlanner()
+{
+    stop();
+}
+
+void HierarchicalPlanner::start()
+{
+    if (running_.exchange(true))
+    {
+        return;
+    }
+    outer_thread_ = std::thread(&HierarchicalPlanner::outer_loop, this);
+    inner_thread_ = std::thread(&HierarchicalPlanner::inner_loop, this);
+    set_thread_affinity(outer_thread_, config_.outer_cpu);
+    set_thread_affinity(inner_thread_, config_.inner_cpu);
+}
+
+void HierarchicalPlanner::stop()
+{
+    running_ = false;
+    if (outer_thread_.joinable())
+    {
+        outer_thread_.join();
+    }
+    if (inner_thread_.joinable())
+    {
+        inner_thread_.join();
+    }
+}
+
+std::string HierarchicalPlanner::summary() const
+{
+    std::lock_guard<std::mutex> outer_lock(outer_stats_mtx_);
+    std::lock_guard<std::mutex> inner_lock(inner_stats_mtx_);
+    return "outer: " + outer_stats_.summary() + "\ninner: " + inner_stats_.summary();
+}
+
+void HierarchicalPlanner::outer_loop()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto period =
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / config_.outer_rate));
+    auto next = Clock::now();
+    while (running_)
+    {
+        auto t_start = Clock::now();
+        double stamp = callbacks_.clock();
+        outer_->solve(callbacks_.state(stamp), callbacks_.reference());
+
+        // after a failed solve state_trajectory() is still the last good plan, which keeps its own stamp in the buffer
+        bool solved = outer_->status() == SolveStatus::Success || outer_->status() == SolveStatus::NotConverged;
+        if (solved)
+        {
+            Plan &plan = plans_.write_buffer();
+            plan.stamp = stamp;
+            plan.dt = outer_dt_;
+            plan.states = outer_->state_trajectory();
+            if (!plan.states.empty())
+            {
+                plans_.publish();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(outer_stats_mtx_);
+            outer_stats_.add(std::chrono::duration<double>(Clock::now() - t_start).count(), outer_->iterations());
+        }
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void HierarchicalPlanner::inner_loop()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto period =
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / config_.inner_rate));
+    const size_t N = inner_prob_->horizon();
+    const double dt = inner_prob_->dt();
+    std::vector<Eigen::VectorXd> reference(N + 1);
+    bool has_plan = false;
+
+    auto next = Clock::now();
+    while (running_)
+    {
+        has_plan = plans_.update() || has_plan;
+        if (has_plan)
+        {
+            auto t_start = Clock::now();
+            double t = callbacks_.clock();
+            const Plan &plan = plans_.read_buffer();
+            for (size_t k = 0; k <= N; k++)
+            {
+                reference[k] = plan.state(t + k * dt);
+            }
+            Eigen::VectorXd u = inner_->solve(callbacks_.state(t), JointTrackingProb::reference_parameter(reference));
+            callbacks_.command(u, t);
+
+            std::lock_guard<std::mutex> lock(inner_stats_mtx_);
+            inner_stats_.add(std::chrono::duration<double>(Clock::now() - t_start).count(), inner_->iterations());
+        }
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+}
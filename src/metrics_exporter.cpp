@@ -0,0 +1,131 @@
+#include <nmpc_motion_planner/metrics_exporter.hpp>
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace casadi_mpc_template;
+
+MetricsExporter::MetricsExporter(std::shared_ptr<const MetricsRegistry> registry, int port,
+                                 const std::string &socket_path)
+    : registry_(registry), socket_path_(socket_path)
+{
+    auto fail = [this](const std::string &what) {
+        std::string error = "metrics exporter: " + what + ": " + std::strerror(errno);
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+        throw std::runtime_error(error);
+    };
+
+    if (!socket_path_.empty())
+    {
+        sockaddr_un addr{};
+        if (socket_path_.size() >= sizeof(addr.sun_path))
+        {
+            throw std::runtime_error("metrics exporter: socket path too long: " + socket_path_);
+        }
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd_ < 0)
+        {
+            fail("socket");
+        }
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path) - 1);
+        ::unlink(socket_path_.c_str());
+        if (::bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            fail("bind " + socket_path_);
+        }
+    }
+    else
+    {
+        fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd_ < 0)
+        {
+            fail("socket");
+        }
+        int one = 1;
+        ::setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (::bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            fail("bind 127.0.0.1:" + std::to_string(port));
+        }
+        socklen_t len = sizeof(addr);
+        ::getsockname(fd_, reinterpret_cast<sockaddr *>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+    }
+    if (::listen(fd_, 8) < 0)
+    {
+        fail("listen");
+    }
+    thread_ = std::thread(&MetricsExporter::serve, this);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    stop_ = true;
+    thread_.join();
+    ::close(fd_);
+    if (!socket_path_.empty())
+    {
+        ::unlink(socket_path_.c_str());
+    }
+}
+
+void MetricsExporter::serve()
+{
+    while (!stop_)
+    {
+        // wakes up regularly to check stop_
+        pollfd pfd{fd_, POLLIN, 0};
+        if (::poll(&pfd, 1, 100) <= 0)
+        {
+            continue;
+        }
+        int client = ::accept(fd_, nullptr, nullptr);
+        if (client < 0)
+        {
+            continue;
+        }
+        // the request itself does not matter, every path gets the metrics; read its header so the client sees a
+        // complete exchange
+        char buffer[1024];
+        std::string request;
+        pollfd cfd{client, POLLIN, 0};
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192 && ::poll(&cfd, 1, 100) > 0)
+        {
+            ssize_t n = ::recv(client, buffer, sizeof(buffer), 0);
+            if (n <= 0)
+            {
+                break;
+            }
+            request.append(buffer, n);
+        }
+
+        std::string body = registry_->render();
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                               std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size())
+        {
+            ssize_t n = ::send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                break;
+            }
+            sent += n;
+        }
+        ::close(client);
+        requests_++;
+    }
+}
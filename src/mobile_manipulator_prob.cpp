@@ -0,0 +1,60 @@
+#include <nmpc_motion_planner/mobile_manipulator_prob.hpp>
+
+using namespace casadi_mpc_template;
+
+MobileManipulatorProb::MobileManipulatorProb(DynamicsType dynamics_type, int horizon_length, double dt)
+    : MotionPlanningProb(dynamics_type, 2 * (base_dofs + 6), base_dofs + 6, horizon_length, dt)
+{
+    using namespace casadi;
+    // moving the base is more expensive than moving the arm
+    Q_vel = DM::diag({50, 50, 50, 10, 10, 10, 10, 10, 10});
+    R = DM::diag({0.1, 0.1, 0.1, 0.01, 0.01, 0.01, 0.01, 0.01, 0.01});
+}
+
+void MobileManipulatorProb::set_ur20_bounds(double accel_limit)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    auto limits = ur20_joint_limits();
+    Eigen::VectorXd q_lb(9), q_ub(9), v_lb(9), v_ub(9), u_lb(9), u_ub(9);
+    q_lb << -inf, -inf, -inf, limits.pos_lower;
+    q_ub << inf, inf, inf, limits.pos_upper;
+    v_lb << -base_vel_limit, limits.vel_lower;
+    v_ub << base_vel_limit, limits.vel_upper;
+    u_lb << -base_accel_limit, Eigen::VectorXd::Constant(6, -accel_limit);
+    u_ub << base_accel_limit, Eigen::VectorXd::Constant(6, accel_limit);
+    set_input_bound(u_lb, u_ub);
+    set_state_bound((Eigen::VectorXd(18) << q_lb, v_lb).finished(), (Eigen::VectorXd(18) << q_ub, v_ub).finished());
+}
+
+casadi::MX MobileManipulatorProb::base_transform(casadi::MX base_pose) const
+{
+    using namespace casadi;
+    MX c = cos(base_pose(2)), s = sin(base_pose(2));
+
+    MX T = MX::eye(4);
+    T(0, 0) = c;
+    T(0, 1) = -s;
+    T(1, 0) = s;
+    T(1, 1) = c;
+    T(0, 3) = base_pose(0) + c * mount_offset.x() - s * mount_offset.y();
+    T(1, 3) = base_pose(1) + s * mount_offset.x() + c * mount_offset.y();
+    T(2, 3) = mount_offset.z();
+    return T;
+}
+
+std::vector<casadi::MX> MobileManipulatorProb::joint_transforms(casadi::MX q)
+{
+    using namespace casadi;
+    MX T_base = base_transform(q(Slice(0, base_dofs)));
+    std::vector<MX> transforms = MotionPlanningProb::joint_transforms(q(Slice(base_dofs, base_dofs + 6)));
+    for (auto &T : transforms)
+    {
+        T = mtimes(T_base, T);
+    }
+    return transforms;
+}
+
+casadi::MX MobileManipulatorProb::singularity_measures(casadi::MX q)
+{
+    return MotionPlanningProb::singularity_measures(q(casadi::Slice(base_dofs, base_dofs + 6)));
+}
@@ -0,0 +1,164 @@
+// Offline solver option tuning on the headless simulator.
+// For IPOPT and sqpmethod with qpOASES, HPIPM and OSQP the options below are tuned by coordinate descent (one option
+// at a time over its candidate values, keeping the best). The score is the mean over the scenarios of the p95 solve
+// time; a candidate whose final end effector error exceeds the tolerance or that produces NaN/Inf is rejected. The best
+// profile is written to a file that nmpc_planner loads through ~solver_profile.
+//
+// usage: rosrun nmpc_motion_planner nmpc_autotune <profile> [steps] [horizon] [error_tolerance]
+
+#include <nmpc_motion_planner/headless_sim.hpp>
+#include <nmpc_motion_planner/solver_profile.hpp>
+
+#include <iostream>
+#include <limits>
+
+using namespace casadi_mpc_template;
+
+namespace
+{
+
+struct SearchDimension
+{
+    std::string key; // flat option key, see flatten_options()
+    std::vector<casadi::GenericType> values;
+};
+
+struct Backend
+{
+    std::string name;
+    SolverProfile start;
+    std::vector<SearchDimension> dimensions;
+};
+
+std::vector<Backend> search_space()
+{
+    std::vector<Backend> backends;
+
+    backends.push_back({"ipopt",
+                        {"ipopt", MPC::default_config()},
+                        {{"ipopt.mu_strategy", {"monotone", "adaptive"}},
+                         {"ipopt.mu_init", {1e-1, 1e-3, 1e-5}},
+                         {"ipopt.tol", {1e-8, 1e-6, 1e-4}},
+                         {"ipopt.bound_push", {1e-2, 1e-5, 1e-8}},
+                         {"ipopt.warm_start_bound_push", {1e-3, 1e-6, 1e-9}},
+                         {"ipopt.warm_start_mult_bound_push", {1e-3, 1e-6, 1e-9}},
+                         {"ipopt.max_iter", {20, 50, 3000}}}});
+
+    std::vector<SearchDimension> sqp = {
+        {"max_iter", {1, 2, 5, 100}}, {"tol_pr", {1e-6, 1e-4}}, {"tol_du", {1e-6, 1e-4}}};
+
+    auto with = [&](std::vector<SearchDimension> qp) {
+        qp.insert(qp.begin(), sqp.begin(), sqp.end());
+        return qp;
+    };
+    backends.push_back({"qpoases",
+                        {"sqpmethod", MPC::default_qpoases_config()},
+                        with({{"qpsol_options.enableRegularisation", {true, false}},
+                              {"qpsol_options.sparse", {false, true}}})});
+    backends.push_back({"hpipm",
+                        {"sqpmethod", MPC::default_hpipm_config()},
+                        with({{"qpsol_options.hpipm.iter_max", {20, 50, 100}},
+                              {"qpsol_options.hpipm.mode", {"speed", "balance", "robust"}}})});
+    backends.push_back({"osqp",
+                        {"sqpmethod", MPC::default_osqp_config()},
+                        with({{"qpsol_options.osqp.eps_abs", {1e-3, 1e-4, 1e-5}},
+                              {"qpsol_options.osqp.eps_rel", {1e-3, 1e-4, 1e-5}},
+                              {"qpsol_options.osqp.rho", {0.01, 0.1, 1.0}}})});
+    return backends;
+}
+
+// mean p95 solve time over the scenarios, infinity if a scenario is not solved to the tolerance
+double score(std::shared_ptr<MotionPlanningProb> prob, const HeadlessSimulator &sim,
+             const std::vector<SimScenario> &scenarios, const SolverProfile &profile, double error_tolerance)
+{
+    double total = 0;
+    try
+    {
+        for (auto &scenario : scenarios)
+        {
+            MPC mpc(prob, profile.solver, profile.options);
+            mpc.set_shift_warm_start(true);
+            SimResult result = sim.run(mpc, scenario);
+            if (!result.finite || result.final_position_error > error_tolerance)
+            {
+                return std::numeric_limits<double>::infinity();
+            }
+            total += result.stats.time_quantile(0.95);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "candidate failed: " << e.what() << std::endl;
+        return std::numeric_limits<double>::infinity();
+    }
+    return total / scenarios.size();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: nmpc_autotune <profile> [steps] [horizon] [error_tolerance]" << std::endl;
+        return 1;
+    }
+    std::string output = argv[1];
+    size_t steps = argc > 2 ? std::stoul(argv[2]) : 300;
+    size_t horizon = argc > 3 ? std::stoul(argv[3]) : 10;
+    double error_tolerance = argc > 4 ? std::stod(argv[4]) : 5e-3;
+    const double dt = 0.01;
+
+    auto prob = std::make_shared<MotionPlanningProb>(Problem::DynamicsType::ContinuesRK4, 12, 6, horizon, dt);
+    prob->set_ur20_bounds();
+    HeadlessSimulator sim(prob);
+    auto scenarios = sim.default_scenarios(steps);
+
+    SolverProfile best;
+    double best_score = std::numeric_limits<double>::infinity();
+    std::string best_backend;
+
+    for (auto &backend : search_space())
+    {
+        casadi::Dict current = flatten_options(backend.start.options);
+        double current_score =
+            score(prob, sim, scenarios, {backend.start.solver, nest_options(current)}, error_tolerance);
+        std::cout << backend.name << " default: " << current_score << " s" << std::endl;
+
+        for (auto &dim : backend.dimensions)
+        {
+            for (auto &value : dim.values)
+            {
+                casadi::Dict candidate = current;
+                candidate[dim.key] = value;
+                SolverProfile profile = {backend.start.solver, nest_options(candidate)};
+                double s = score(prob, sim, scenarios, profile, error_tolerance);
+                std::cout << backend.name << " " << dim.key << " = " << format_option_value(dim.key, value) << ": " << s
+                          << " s" << std::endl;
+                if (s < current_score)
+                {
+                    current_score = s;
+                    current = candidate;
+                }
+            }
+        }
+
+        if (current_score < best_score)
+        {
+            best_score = current_score;
+            best = {backend.start.solver, nest_options(current)};
+            best_backend = backend.name;
+        }
+    }
+
+    if (best_score == std::numeric_limits<double>::infinity())
+    {
+        std::cerr << "no candidate reached the error tolerance " << error_tolerance << std::endl;
+        return 1;
+    }
+    std::string comment = "nmpc_autotune: backend " + best_backend + ", horizon " + std::to_string(horizon) +
+                          ", mean p95 solve time " + std::to_string(best_score) + " s";
+    save_solver_profile(output, best, comment);
+    std::cout << "best: " << comment << ", written to " << output << std::endl;
+    return 0;
+}
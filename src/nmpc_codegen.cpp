@@ -0,0 +1,162 @@
+// Generates the complete NMPC solver (sqpmethod + qrqp) and the forward kinematics as self-contained C code.
+// Besides the CasADi generated <name>.c, <name>_config.h is written with the problem dimensions, the work vector
+// sizes, the bounds and a traits struct, so CodegenMPC can allocate every workspace statically.
+//
+// usage: rosrun nmpc_motion_planner nmpc_codegen <output_dir> [--name nmpc_solver] [--horizon 10] [--dt 0.01]
+//                                                [--precision double|float] [--max-iter 20]
+//
+// The default set used by nmpc_codegen_benchmark and MixedPrecisionMPC:
+//   nmpc_codegen <dir>
+//   nmpc_codegen <dir> --name nmpc_solver_f32 --precision float
+//   nmpc_codegen <dir> --name nmpc_solver_refine --max-iter 1
+
+#include <nmpc_motion_planner/nmpc_prob.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+using namespace casadi_mpc_template;
+
+static void write_array(std::ofstream &out, const std::string &type, const std::string &name,
+                        const casadi::DM &values)
+{
+    out << "static const " << type << " " << name << "[" << std::max<casadi_int>(values.numel(), 1) << "] = {";
+    for (casadi_int i = 0; i < values.numel(); i++)
+    {
+        double v = values.nonzeros()[i];
+        if (std::isinf(v))
+        {
+            out << (v > 0 ? "INFINITY" : "-INFINITY");
+        }
+        else
+        {
+            out << std::setprecision(17) << v;
+        }
+        out << (i + 1 < values.numel() ? ", " : "");
+    }
+    out << "};\n";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " <output_dir> [--name nmpc_solver] [--horizon 10] [--dt 0.01] [--precision double|float]"
+                     " [--max-iter 20]"
+                  << std::endl;
+        return 1;
+    }
+    std::string out_dir = argv[1];
+    std::string name = "nmpc_solver";
+    std::string precision = "double";
+    int horizon = 10;
+    double dt = 0.01;
+    int max_iter = 20;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        std::string opt = argv[i];
+        if (opt == "--name")
+            name = argv[i + 1];
+        else if (opt == "--horizon")
+            horizon = std::stoi(argv[i + 1]);
+        else if (opt == "--dt")
+            dt = std::stod(argv[i + 1]);
+        else if (opt == "--precision")
+            precision = argv[i + 1];
+        else if (opt == "--max-iter")
+            max_iter = std::stoi(argv[i + 1]);
+        else
+        {
+            std::cerr << "unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+    if (precision != "double" && precision != "float")
+    {
+        std::cerr << "precision must be double or float" << std::endl;
+        return 1;
+    }
+
+    auto prob = std::make_shared<MotionPlanningProb>(Problem::DynamicsType::ContinuesRK4, 12, 6, horizon, dt);
+    prob->set_ur20_bounds();
+
+    casadi::Dict config = MPC::default_qrqp_config();
+    config["max_iter"] = max_iter;
+    MPC mpc(prob, "sqpmethod", config);
+
+    // wrap under a unique name so several variants can be linked into one binary, the dependencies are static
+    casadi::Function nlp = mpc.solver();
+    std::vector<casadi::MX> nlp_in = nlp.mx_in();
+    casadi::Function solver(name, nlp_in, nlp(nlp_in), nlp.name_in(), nlp.name_out());
+
+    casadi::MX q = casadi::MX::sym("q", 6);
+    casadi::Function fk(name + "_fk", {q}, {prob->forward_kinematics(q)});
+
+    casadi::CodeGenerator gen(name + ".c", casadi::Dict{{"with_header", true},
+                                                        {"with_mem", false},
+                                                        {"casadi_real", precision},
+                                                        {"casadi_int", "long long int"}});
+    gen.add(solver);
+    gen.add(fk);
+    gen.generate(out_dir + "/");
+
+    // the generated header defines casadi_real, which collides between precisions, so prototypes are repeated here
+    const std::string real = name + "_real";
+    const std::string upper = [&] {
+        std::string s = name;
+        std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+        return s;
+    }();
+
+    std::ofstream config_h(out_dir + "/" + name + "_config.h");
+    config_h << "/* generated by nmpc_codegen, do not edit */\n"
+             << "#pragma once\n"
+             << "#include <math.h>\n\n"
+             << "typedef " << precision << " " << real << ";\n\n"
+             << "#define " << upper << "_NX " << prob->nx() << "\n"
+             << "#define " << upper << "_NU " << prob->nu() << "\n"
+             << "#define " << upper << "_NP " << prob->np() << "\n"
+             << "#define " << upper << "_HORIZON " << prob->horizon() << "\n"
+             << "#define " << upper << "_DT " << std::setprecision(17) << prob->dt() << "\n"
+             << "#define " << upper << "_NW " << solver.nnz_in("x0") << "\n"
+             << "#define " << upper << "_NG " << solver.nnz_in("lbg") << "\n"
+             << "#define " << upper << "_SZ_ARG " << solver.sz_arg() << "\n"
+             << "#define " << upper << "_SZ_RES " << solver.sz_res() << "\n"
+             << "#define " << upper << "_SZ_IW " << solver.sz_iw() << "\n"
+             << "#define " << upper << "_SZ_W " << solver.sz_w() << "\n"
+             << "#define " << upper << "_FK_SZ_W " << fk.sz_w() << "\n\n"
+             << "#ifdef __cplusplus\nextern \"C\" {\n#endif\n"
+             << "int " << name << "(const " << real << " **arg, " << real << " **res, long long int *iw, " << real
+             << " *w, int mem);\n"
+             << "int " << name << "_fk(const " << real << " **arg, " << real << " **res, long long int *iw, " << real
+             << " *w, int mem);\n"
+             << "#ifdef __cplusplus\n}\n#endif\n\n";
+    write_array(config_h, real, name + "_lbx", mpc.lbx());
+    write_array(config_h, real, name + "_ubx", mpc.ubx());
+    write_array(config_h, real, name + "_lbg", mpc.lbg());
+    write_array(config_h, real, name + "_ubg", mpc.ubg());
+
+    config_h << "\n#ifdef __cplusplus\n"
+             << "struct " << name << "_traits\n{\n"
+             << "    using real = " << real << ";\n"
+             << "    static constexpr int nx = " << upper << "_NX, nu = " << upper << "_NU, np = " << upper
+             << "_NP, nw = " << upper << "_NW, ng = " << upper << "_NG;\n"
+             << "    static constexpr int sz_arg = " << upper << "_SZ_ARG, sz_res = " << upper
+             << "_SZ_RES, sz_iw = " << upper << "_SZ_IW, sz_w = " << upper << "_SZ_W;\n"
+             << "    static constexpr int fk_sz_w = " << upper << "_FK_SZ_W;\n"
+             << "    static const real *lbx() { return " << name << "_lbx; }\n"
+             << "    static const real *ubx() { return " << name << "_ubx; }\n"
+             << "    static const real *lbg() { return " << name << "_lbg; }\n"
+             << "    static const real *ubg() { return " << name << "_ubg; }\n"
+             << "    static int eval(const real **arg, real **res, long long int *iw, real *w) { return " << name
+             << "(arg, res, iw, w, 0); }\n"
+             << "    static int fk(const real **arg, real **res, long long int *iw, real *w) { return " << name
+             << "_fk(arg, res, iw, w, 0); }\n"
+             << "};\n#endif\n";
+
+    std::cout << "Generated " << name << " (" << precision << ", nw = " << solver.nnz_in("x0")
+              << ", ng = " << solver.nnz_in("lbg") << ", sz_w = " << solver.sz_w() << ") in " << out_dir << std::endl;
+    return 0;
+}
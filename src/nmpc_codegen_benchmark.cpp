@@ -0,0 +1,110 @@
+// Closed-loop comparison of the code generated solvers in double, float and mixed precision.
+// Needs nmpc_solver, nmpc_solver_f32 and nmpc_solver_refine generated into NMPC_CODEGEN_DIR (see nmpc_codegen.cpp).
+//
+// usage: rosrun nmpc_motion_planner nmpc_codegen_benchmark [steps]
+
+#include <nmpc_motion_planner/codegen_mpc.hpp>
+
+#include <nmpc_solver_config.h>
+#include <nmpc_solver_f32_config.h>
+#include <nmpc_solver_refine_config.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace casadi_mpc_template;
+
+struct Result
+{
+    std::vector<double> solve_times;
+    std::vector<Eigen::Vector3d> ee_path;
+    double final_error;
+};
+
+static Eigen::Matrix4d fk(const Eigen::VectorXd &q)
+{
+    Eigen::Matrix4d T;
+    CodegenMPC<nmpc_solver_traits>::forward_kinematics(q.data(), T.data());
+    return T;
+}
+
+template <class MPCType>
+static Result run(MPCType &mpc, const Eigen::VectorXd &x_init, const Eigen::VectorXd &p, int steps)
+{
+    const double dt = NMPC_SOLVER_DT;
+    Result result;
+    Eigen::VectorXd x = x_init;
+    for (int k = 0; k < steps; k++)
+    {
+        auto t_start = std::chrono::steady_clock::now();
+        Eigen::VectorXd u = mpc.solve(x, p);
+        auto t_end = std::chrono::steady_clock::now();
+        result.solve_times.push_back(std::chrono::duration<double, std::micro>(t_end - t_start).count());
+
+        x.head(6) += x.tail(6) * dt + 0.5 * u * dt * dt;
+        x.tail(6) += u * dt;
+        result.ee_path.push_back(fk(x.head(6)).block<3, 1>(0, 3));
+    }
+    result.final_error = (result.ee_path.back() - p.head(3)).norm();
+    return result;
+}
+
+static void report(const std::string &name, Result result, const Result &reference)
+{
+    double max_dev = 0;
+    for (size_t k = 0; k < result.ee_path.size(); k++)
+    {
+        max_dev = std::max(max_dev, (result.ee_path[k] - reference.ee_path[k]).norm());
+    }
+    std::sort(result.solve_times.begin(), result.solve_times.end());
+    double mean = 0;
+    for (double t : result.solve_times)
+    {
+        mean += t / result.solve_times.size();
+    }
+    std::cout << name << ": mean " << mean << " us, p99 " << result.solve_times[result.solve_times.size() * 99 / 100]
+              << " us, max " << result.solve_times.back() << " us, final error " << result.final_error
+              << " m, max path deviation from double " << max_dev << " m" << std::endl;
+}
+
+template <class Solver> static double fk_time(const Eigen::VectorXd &q, int repeat)
+{
+    double T[16];
+    auto t_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; i++)
+    {
+        CodegenMPC<Solver>::forward_kinematics(q.data(), T);
+    }
+    auto t_end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t_end - t_start).count() / repeat;
+}
+
+int main(int argc, char **argv)
+{
+    int steps = argc > 1 ? std::stoi(argv[1]) : 300;
+
+    Eigen::VectorXd x_init = Eigen::VectorXd::Zero(12);
+    x_init.head(6) << 0.0, -1.0, 1.0, 0.0, 0.0, 0.0;
+
+    // reachable target: end effector pose of a goal configuration
+    Eigen::VectorXd q_goal = (Eigen::VectorXd(6) << 0.5, -1.2, 1.4, -0.3, 0.4, 0.2).finished();
+    Eigen::Matrix4d T_goal = fk(q_goal);
+    Eigen::Quaterniond quat(Eigen::Matrix3d(T_goal.block<3, 3>(0, 0)));
+    Eigen::VectorXd p(7);
+    p << T_goal.block<3, 1>(0, 3), quat.w(), quat.x(), quat.y(), quat.z();
+
+    static CodegenMPC<nmpc_solver_traits> mpc_double;
+    static CodegenMPC<nmpc_solver_f32_traits> mpc_float;
+    static MixedPrecisionMPC<nmpc_solver_f32_traits, nmpc_solver_refine_traits> mpc_mixed;
+
+    Result ref = run(mpc_double, x_init, p, steps);
+    report("double", ref, ref);
+    report("float ", run(mpc_float, x_init, p, steps), ref);
+    report("mixed ", run(mpc_mixed, x_init, p, steps), ref);
+
+    std::cout << "fk: double " << fk_time<nmpc_solver_traits>(q_goal, 100000) << " ns, float "
+              << fk_time<nmpc_solver_f32_traits>(q_goal, 100000) << " ns" << std::endl;
+    return 0;
+}
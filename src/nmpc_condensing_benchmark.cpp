@@ -0,0 +1,63 @@
+// Solve time of partially condensed problems (Problem::set_condensing_block) over the condensing block size M for
+// horizons from 20 to 100 stages, sqpmethod RTI with qpOASES, HPIPM and OSQP on the headless simulator. HPIPM gets the
+// stage dimensions of the block condensed QP, so its column shows the effect of M on the OCP QP solver. The table is
+// Markdown, also written to [table] when given.
+//
+// usage: rosrun nmpc_motion_planner nmpc_condensing_benchmark [steps] [table]
+
+#include <nmpc_motion_planner/headless_sim.hpp>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace casadi_mpc_template;
+
+int main(int argc, char **argv)
+{
+    size_t steps = argc > 1 ? std::stoul(argv[1]) : 100;
+    const double dt = 0.01;
+
+    std::vector<std::pair<std::string, casadi::Dict>> backends = {
+        {"qpoases", MPC::rti_config(MPC::default_qpoases_config())},
+        {"hpipm", MPC::rti_config(MPC::default_hpipm_config())},
+        {"osqp", MPC::rti_config(MPC::default_osqp_config())}};
+
+    std::ostringstream table;
+    table << "| backend | N | M | mean [s] | p95 [s] | error [m] |\n|---|---|---|---|---|---|\n";
+    std::cout << table.str() << std::flush;
+    for (size_t N : {20, 40, 60, 80, 100})
+    {
+        for (size_t M : {1, 2, 4, 5, 10, 20})
+        {
+            if (M > N)
+            {
+                continue;
+            }
+            auto prob = std::make_shared<MotionPlanningProb>(Problem::DynamicsType::ContinuesRK4, 12, 6, N, dt);
+            prob->set_ur20_bounds();
+            prob->set_condensing_block(M);
+            HeadlessSimulator sim(prob);
+            SimScenario scenario = sim.default_scenarios(steps)[1];
+
+            for (auto &backend : backends)
+            {
+                MPC mpc(prob, "sqpmethod", backend.second);
+                mpc.set_shift_warm_start(true);
+                SimResult result = sim.run(mpc, scenario);
+                std::ostringstream row;
+                row << "| " << backend.first << " | " << N << " | " << M << " | " << std::setprecision(4)
+                    << result.stats.mean_time() << " | " << result.stats.time_quantile(0.95) << " | "
+                    << result.final_position_error << " |\n";
+                std::cout << row.str() << std::flush;
+                table << row.str();
+            }
+        }
+    }
+    if (argc > 2)
+    {
+        std::ofstream(argv[2]) << table.str();
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+// Offline diagnosis of a failed solve written by nmpc_planner (~diagnostics_file, see FailurePoint).
+// Rebuilds the planner problem from the ProblemSpec stored with the failure (the default problem with the horizon and
+// dt of the failure for files without one), then evaluates every component Function (forward
+// kinematics, pose errors, singularity measures, stage cost, dynamics, NLP objective/constraints and their derivatives)
+// stage by stage on the failing initial guess and reports where NaN/Inf first appears.
+//
+// usage: rosrun nmpc_motion_planner nmpc_diagnose <failure_file>
+
+#include <nmpc_motion_planner/problem_spec.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+using namespace casadi_mpc_template;
+
+namespace
+{
+
+std::vector<size_t> non_finite(const std::vector<double> &v)
+{
+    std::vector<size_t> idx;
+    for (size_t i = 0; i < v.size(); i++)
+    {
+        if (!std::isfinite(v[i]))
+        {
+            idx.push_back(i);
+        }
+    }
+    return idx;
+}
+
+casadi::DM to_dm(const Eigen::VectorXd &v)
+{
+    return std::vector<double>(v.data(), v.data() + v.size());
+}
+
+std::string format(const std::vector<double> &v)
+{
+    std::ostringstream os;
+    for (double d : v)
+    {
+        os << " " << d;
+    }
+    return os.str();
+}
+
+// evaluates f on args and prints the non-finite outputs, returns true if all are finite
+bool check(const std::string &name, const casadi::Function &f, const std::vector<casadi::DM> &args)
+{
+    std::vector<casadi::DM> res = f(args);
+    bool ok = true;
+    for (size_t i = 0; i < res.size(); i++)
+    {
+        auto bad = non_finite(res[i].nonzeros());
+        if (!bad.empty())
+        {
+            ok = false;
+            std::cout << "  " << name << " output " << f.name_out(i) << ": " << bad.size() << " non-finite entries"
+                      << " (first at " << bad[0] << ")" << std::endl;
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    using namespace casadi;
+    if (argc < 2)
+    {
+        std::cerr << "usage: nmpc_diagnose <failure_file>" << std::endl;
+        return 1;
+    }
+    FailurePoint point = FailurePoint::load(argv[1]);
+    std::cout << "status: " << to_string(point.status) << ", horizon " << point.horizon << ", dt " << point.dt
+              << std::endl;
+
+    bool inputs_ok = true;
+    for (auto &input : std::vector<std::pair<std::string, Eigen::VectorXd>>{{"x0", point.x0}, {"p", point.p}})
+    {
+        auto bad = non_finite(std::vector<double>(input.second.data(), input.second.data() + input.second.size()));
+        if (!bad.empty())
+        {
+            inputs_ok = false;
+            std::cout << input.first << " has non-finite entries at";
+            for (size_t i : bad)
+            {
+                std::cout << " " << i;
+            }
+            std::cout << std::endl;
+        }
+    }
+    if (!inputs_ok)
+    {
+        std::cout << "-> the solve inputs are invalid (state estimate or reference)" << std::endl;
+        return 0;
+    }
+
+    ProblemSpec spec;
+    if (point.problem.empty())
+    {
+        std::cout << "no problem description stored, assuming the default problem" << std::endl;
+        spec.horizon = point.horizon;
+        spec.dt = point.dt;
+    }
+    else
+    {
+        spec = ProblemSpec::parse(point.problem, argv[1]);
+    }
+    auto prob = spec.make_problem();
+    SolverProfile profile = spec.solver_profile();
+    MPC mpc(prob, profile.solver, profile.options);
+    const size_t nx = prob->nx();
+    const size_t nu = prob->nu();
+    const size_t N = prob->horizon();
+    const casadi_int nw = mpc.lbx().size1();
+    if (point.w_guess.size() == 0)
+    {
+        // failure on the first solve, the solver started from zero with X_0 = x0
+        point.w_guess = Eigen::VectorXd::Zero(nw);
+        point.w_guess.head(nx) = point.x0;
+    }
+    if (point.w_guess.size() != nw)
+    {
+        std::cerr << "initial guess has " << point.w_guess.size() << " entries, the rebuilt problem " << nw
+                  << std::endl;
+        return 1;
+    }
+
+    auto bad_solution = non_finite(
+        std::vector<double>(point.w_solution.data(), point.w_solution.data() + point.w_solution.size()));
+    std::cout << "solution: " << bad_solution.size() << " non-finite entries" << std::endl;
+
+    // component Functions in the order they are evaluated inside the stage cost
+    MX q = MX::sym("q", nx / 2), x = MX::sym("x", nx), u = MX::sym("u", nu), p = prob->parameter();
+    MX pose = prob->end_effector_pose(q);
+    std::vector<std::pair<std::string, Function>> q_components = {
+        {"end_effector_pose", Function("end_effector_pose", {q}, {pose}, {"q"}, {"pose"})},
+        {"translation_error",
+         Function("translation_error", {q, p}, {prob->compute_trans_error(pose(Slice(0, 3)))}, {"q", "p"}, {"e"})},
+        {"orientation_error",
+         Function("orientation_error", {q, p}, {prob->compute_ori_error(pose(Slice(3, 7)))}, {"q", "p"}, {"e"})},
+        {"singularity_measures", Function("singularity_measures", {q}, {prob->singularity_measures(q)}, {"q"}, {"m"})},
+    };
+    MX L = prob->stage_cost(x, u);
+    Function stage_cost("stage_cost", {x, u, p}, {L, gradient(L, x), gradient(L, u)}, {"x", "u", "p"},
+                        {"L", "dL_dx", "dL_du"});
+    Function dynamics("dynamics", {x, u}, {prob->discrete_dynamics()(x, u)}, {"x", "u"}, {"x_next"});
+
+    DM w = to_dm(point.w_guess), pd = to_dm(point.p);
+    std::vector<double> wv = w.nonzeros();
+    bool found = false;
+    for (size_t k = 0; k <= N && !found; k++)
+    {
+        if (k >= mpc.state_offsets().size())
+        {
+            break;
+        }
+        size_t xo = mpc.state_offsets()[k];
+        DM xk = std::vector<double>(wv.begin() + xo, wv.begin() + xo + nx);
+        DM qk = std::vector<double>(wv.begin() + xo, wv.begin() + xo + nx / 2);
+        for (auto &component : q_components)
+        {
+            std::vector<DM> args = component.second.n_in() == 2 ? std::vector<DM>{qk, pd} : std::vector<DM>{qk};
+            if (!check("stage " + std::to_string(k) + " " + component.first, component.second, args))
+            {
+                std::cout << "-> first failure in " << component.first << " at stage " << k
+                          << ", q =" << format(qk.nonzeros()) << std::endl;
+                found = true;
+                break;
+            }
+        }
+        if (found || k == N || k >= mpc.input_offsets().size())
+        {
+            continue;
+        }
+        size_t uo = mpc.input_offsets()[k];
+        DM uk = std::vector<double>(wv.begin() + uo, wv.begin() + uo + nu);
+        if (!check("stage " + std::to_string(k) + " stage_cost", stage_cost, {xk, uk, pd}) ||
+            !check("stage " + std::to_string(k) + " dynamics", dynamics, {xk, uk}))
+        {
+            std::cout << "-> first failure at stage " << k << ", x =" << format(xk.nonzeros())
+                      << ", u =" << format(uk.nonzeros()) << std::endl;
+            found = true;
+        }
+    }
+
+    // NLP level: objective, constraints and first/second derivatives as seen by the solver
+    MXDict nlp = mpc.casadi_prob();
+    MX nlp_p = nlp.count("p") ? nlp["p"] : MX::sym("p", 0, 1);
+    MX lam = MX::sym("lam", nlp["g"].size1());
+    MX lag = nlp["f"] + dot(lam, nlp["g"]);
+    Function nlp_fn("nlp", {nlp["x"], nlp_p, lam},
+                    {nlp["f"], nlp["g"], gradient(nlp["f"], nlp["x"]), jacobian(nlp["g"], nlp["x"]),
+                     hessian(lag, nlp["x"])},
+                    {"x", "p", "lam_g"}, {"f", "g", "grad_f", "jac_g", "hess_lag"});
+    DM lam_g = DM::ones(nlp["g"].size1());
+    bool nlp_ok = check("nlp", nlp_fn, {w, nlp.count("p") ? pd : DM::zeros(0, 1), lam_g});
+
+    if (!found && nlp_ok)
+    {
+        std::cout << "-> all components are finite on the initial guess; the solver diverged from it (check "
+                     "scaling, bounds and the solver options)"
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Micro-benchmarks of the native LQ/Riccati solvers on the UR20 problem dimensions (nx = 12, nu = 6): runtime vs.
+// fixed size for short horizons, serial vs. parallel-in-time over the number of segments for long horizons.
+//
+// usage: rosrun nmpc_motion_planner nmpc_micro_benchmark [repeat]
+
+#include <nmpc_motion_planner/riccati_solver.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+using namespace casadi_mpc_template;
+
+namespace
+{
+
+constexpr int NX = 12;
+constexpr int NU = 6;
+
+// linearized UR20 RTI subproblem: RK4 discretized double integrator with random cost gradients
+template <class Solver> void fill_stages(Solver &solver, int horizon, double dt, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::normal_distribution<double> dist;
+
+    Eigen::MatrixXd A = Eigen::MatrixXd::Identity(NX, NX);
+    A.block(0, NU, NU, NU) = dt * Eigen::MatrixXd::Identity(NU, NU);
+    Eigen::MatrixXd B = Eigen::MatrixXd::Zero(NX, NU);
+    B.block(0, 0, NU, NU) = 0.5 * dt * dt * Eigen::MatrixXd::Identity(NU, NU);
+    B.block(NU, 0, NU, NU) = dt * Eigen::MatrixXd::Identity(NU, NU);
+
+    for (int k = 0; k < horizon; k++)
+    {
+        auto &s = solver.stage(k);
+        s.A = A;
+        s.B = B;
+        Eigen::MatrixXd L = Eigen::MatrixXd::NullaryExpr(NX, NX, [&]() { return 0.1 * dist(gen); });
+        s.Q = dt * (L * L.transpose() + Eigen::MatrixXd::Identity(NX, NX));
+        s.R = dt * 0.01 * Eigen::MatrixXd::Identity(NU, NU);
+        s.S.setZero();
+        for (int i = 0; i < NX; i++)
+        {
+            s.q[i] = dt * dist(gen);
+            s.c[i] = 1e-3 * dist(gen);
+        }
+        for (int i = 0; i < NU; i++)
+        {
+            s.r[i] = dt * dist(gen);
+        }
+    }
+    solver.Q_N = Eigen::MatrixXd::Identity(NX, NX);
+    solver.q_N.setZero();
+}
+
+template <class F> double time_us(F &&f, int repeat)
+{
+    auto t_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; i++)
+    {
+        f();
+    }
+    auto t_end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t_end - t_start).count() / repeat;
+}
+
+template <int N> void compare_runtime_fixed(double dt, int repeat)
+{
+    Eigen::VectorXd x0 = Eigen::VectorXd::Zero(NX);
+    x0.head(NU) << 0.0, -1.0, 1.0, 0.0, 0.0, 0.0;
+
+    RiccatiSolver runtime(NX, NU, N);
+    fill_stages(runtime, N, dt, 42);
+    static FixedRiccatiSolver<NX, NU, N> fixed;
+    fill_stages(fixed, N, dt, 42);
+
+    double t_runtime = time_us(
+        [&]() {
+            runtime.factorize();
+            runtime.solve(x0);
+        },
+        repeat);
+    double t_fixed = time_us(
+        [&]() {
+            fixed.factorize();
+            fixed.solve(x0);
+        },
+        repeat);
+
+    double max_diff = 0;
+    for (int k = 0; k < N; k++)
+    {
+        max_diff = std::max(max_diff, (runtime.u()[k] - fixed.u()[k]).cwiseAbs().maxCoeff());
+    }
+
+    std::cout << "riccati N = " << N << ": runtime sized " << t_runtime << " us, fixed size " << t_fixed
+              << " us, speedup " << t_runtime / t_fixed << ", max |du| " << max_diff << std::endl;
+}
+
+void compare_serial_parallel(int N, size_t num_segments, double dt, int repeat)
+{
+    Eigen::VectorXd x0 = Eigen::VectorXd::Zero(NX);
+    x0.head(NU) << 0.0, -1.0, 1.0, 0.0, 0.0, 0.0;
+
+    RiccatiSolver serial(NX, NU, N);
+    fill_stages(serial, N, dt, 42);
+    ParallelRiccatiSolver parallel(NX, NU, N, num_segments);
+    fill_stages(parallel, N, dt, 42);
+
+    double t_serial = time_us(
+        [&]() {
+            serial.factorize();
+            serial.solve(x0);
+        },
+        repeat);
+    double t_parallel = time_us(
+        [&]() {
+            parallel.factorize();
+            parallel.solve(x0);
+        },
+        repeat);
+
+    double max_diff = 0;
+    for (int k = 0; k < N; k++)
+    {
+        max_diff = std::max(max_diff, (serial.u()[k] - parallel.u()[k]).cwiseAbs().maxCoeff());
+    }
+
+    std::cout << "riccati N = " << N << ": serial " << t_serial << " us, parallel (" << parallel.num_segments()
+              << " segments) " << t_parallel << " us, speedup " << t_serial / t_parallel << ", max |du| " << max_diff
+              << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int repeat = argc > 1 ? std::stoi(argv[1]) : 2000;
+    const double dt = 0.01;
+
+    compare_runtime_fixed<10>(dt, repeat);
+    compare_runtime_fixed<20>(dt, repeat);
+    compare_runtime_fixed<50>(dt, repeat / 4 + 1);
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (int N : {100, 200, 500})
+    {
+        for (size_t segments = 1; segments < 2 * cores; segments *= 2)
+        {
+            compare_serial_parallel(N, std::min(segments, cores), dt, repeat / 10 + 1);
+        }
+    }
+    return 0;
+}
@@ -1,12 +1,42 @@
 
 
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include <nmpc_motion_planner/allocation_counter.hpp>
+#include <nmpc_motion_planner/backend_switching.hpp>
+#include <nmpc_motion_planner/casadi_scenario_mpc.hpp>
+#include <nmpc_motion_planner/hierarchical_planner.hpp>
+#include <nmpc_motion_planner/joint_state_estimator.hpp>
+#include <nmpc_motion_planner/metrics_exporter.hpp>
 #include <nmpc_motion_planner/nmpc_prob.hpp>
+#include <nmpc_motion_planner/problem_spec.hpp>
+#include <nmpc_motion_planner/shadow_solver.hpp>
+#include <nmpc_motion_planner/solve_statistics.hpp>
+#include <nmpc_motion_planner/solver_profile.hpp>
+#include <nmpc_motion_planner/thread_utils.hpp>
+#include <nmpc_motion_planner/time_optimal_planner.hpp>
+#include <nmpc_motion_planner/tracepoints.hpp>
+#include <nmpc_motion_planner/watchdog.hpp>
+
+NMPC_TRACE_SEMAPHORE(joint_state);
+NMPC_TRACE_SEMAPHORE(joint_state_rejected);
+NMPC_TRACE_SEMAPHORE(model_states);
+NMPC_TRACE_SEMAPHORE(tick_start);
+NMPC_TRACE_SEMAPHORE(solve_start);
+NMPC_TRACE_SEMAPHORE(solve_end);
+NMPC_TRACE_SEMAPHORE(solve_fallback);
+NMPC_TRACE_SEMAPHORE(solver_switch);
+NMPC_TRACE_SEMAPHORE(publish);
+NMPC_TRACE_SEMAPHORE(watchdog_overrun);
 
 class MotionPlanner
 {
   public:
     MotionPlanner()
     {
+        register_metrics();
         joint_state_sub = nh_.subscribe("/ur20/joint_states", 100, &MotionPlanner::joint_states_callback, this);
         target_state_sub = nh_.subscribe("/gazebo/model_states", 100, &MotionPlanner::target_states_callback, this);
         joint_vel_command_pub = nh_.advertise<std_msgs::Float64MultiArray>("/ur20/ur20_joint_controller/command", 100);
@@ -14,18 +44,101 @@ class MotionPlanner
 
         q << 0.0, -1.0, 1.0, 0.0, 0.0, 0.0; // Initial joint position
         x << q, Eigen::VectorXd::Zero(6);
-        joint_pose_lower_limit << -6.283185307179586, -6.283185307179586, -3.141592653589793, -6.283185307179586,
-            -6.283185307179586, -6.283185307179586;
-        joint_pose_upper_limit << 6.283185307179586, 6.283185307179586, 3.141592653589793, 6.283185307179586,
-            6.283185307179586, 6.283185307179586;
-        joint_vel_lower_limit << -2.0943951023931953, -2.0943951023931953, -2.6179938779914944, -3.6651914291880923,
-            -3.6651914291880923, -3.6651914291880923;
-        joint_vel_upper_limit << 2.0943951023931953, 2.0943951023931953, 2.6179938779914944, 3.6651914291880923,
-            3.6651914291880923, 3.6651914291880923;
+
+        ros::NodeHandle pnh("~");
+        pnh.param("num_scenarios", num_scenarios, 1);
+        pnh.param("solver", spec.backend, std::string("ipopt"));
+        pnh.param("shift_warm_start", shift_warm_start, true);
+        pnh.param("rti", spec.rti, false);
+        pnh.param("solver_profile", solver_profile, std::string());
+        pnh.param("diagnostics_file", diagnostics_file, std::string());
+        pnh.param("initial_state_policy", initial_state_policy, std::string("relax"));
+        pnh.param("initial_state_soft_weight", initial_state_soft_weight, 1e3);
+        pnh.param("watchdog/enabled", watchdog_enabled, true);
+        pnh.param("watchdog/deadline", watchdog_deadline, 0.1);
+        pnh.param("watchdog/period", watchdog_period, 0.002);
+        pnh.param("watchdog/deceleration", watchdog_deceleration, 5.0);
+        pnh.param("watchdog/cpu", watchdog_cpu, -1);
+        pnh.param("watchdog/priority", watchdog_priority, 0);
+        int condensing_block, input_control_points;
+        pnh.param("condensing_block", condensing_block, 1);
+        pnh.param("input_control_points", input_control_points, 0);
+        spec.condensing_block = std::max(condensing_block, 1);
+        spec.input_control_points = std::max(input_control_points, 0);
+        pnh.param("time_optimal", time_optimal, false);
+        pnh.param("singularity/elbow_weight", spec.w_elbow, 0.0);
+        pnh.param("singularity/wrist_weight", spec.w_wrist, 0.0);
+        pnh.param("singularity/shoulder_weight", spec.w_shoulder, 0.0);
+        pnh.param("obstacles", spec.obstacles, std::vector<double>());
+        pnh.param("collision/aggregate_rho", spec.collision_rho, 0.0);
+        // a problem spec file replaces the problem and solver params above
+        std::string problem_spec_file;
+        pnh.param("problem_spec", problem_spec_file, std::string());
+        pnh.param("solver_cache_dir", solver_cache_dir, std::string());
+        if (!problem_spec_file.empty())
+        {
+            try
+            {
+                spec = casadi_mpc_template::ProblemSpec::load(problem_spec_file);
+                ROS_INFO_STREAM("Using problem spec " << problem_spec_file << " (hash " << spec.hash() << ")");
+            }
+            catch (const std::exception &e)
+            {
+                ROS_ERROR_STREAM("Ignoring problem spec: " << e.what());
+            }
+        }
+        dt = spec.dt;
+        pnh.param("shadow/enabled", shadow_enabled, false);
+        pnh.param("shadow/solver", shadow_solver, std::string("ipopt"));
+        pnh.param("shadow/rti", shadow_rti, false);
+        pnh.param("shadow/horizon", shadow_horizon, 0);
+        pnh.param("shadow/solver_profile", shadow_solver_profile, std::string());
+        pnh.param("shadow/cpu", shadow_cpu, -1);
+        pnh.param("shadow/log_file", shadow_log_file, std::string("nmpc_shadow.csv"));
+        pnh.param("switching/enabled", switching_enabled, false);
+        pnh.param("switching/levels", switching_levels, std::vector<std::string>{"rti-qpoases", "qpoases", "ipopt"});
+        pnh.param("switching/horizons", switching_horizons, std::vector<int>());
+        int initial_level, misses, window, dwell;
+        pnh.param("switching/initial_level", initial_level, 0);
+        pnh.param("switching/downgrade_load", switching_config.downgrade_load, 0.8);
+        pnh.param("switching/upgrade_load", switching_config.upgrade_load, 0.4);
+        pnh.param("switching/max_misses", misses, 3);
+        pnh.param("switching/window", window, 100);
+        pnh.param("switching/dwell", dwell, 500);
+        switching_initial_level = std::max(initial_level, 0);
+        switching_config.max_misses = std::max(misses, 1);
+        switching_config.window = std::max(window, 1);
+        switching_config.dwell = std::max(dwell, 1);
+        pnh.param("metrics/enabled", metrics_enabled, false);
+        pnh.param("metrics/port", metrics_port, 9464);
+        pnh.param("metrics/socket", metrics_socket, std::string());
+        pnh.param("hierarchical", hierarchical, false);
+        pnh.param("hierarchical/outer_dt", outer_dt, 0.05);
+        pnh.param("hierarchical/outer_horizon", outer_horizon, 40);
+        pnh.param("hierarchical/inner_horizon", inner_horizon, 10);
+        pnh.param("hierarchical/outer_rate", outer_rate, 10.0);
+        pnh.param("hierarchical/inner_rate", inner_rate, 200.0);
+        pnh.param("hierarchical/outer_cpu", outer_cpu, -1);
+        pnh.param("hierarchical/inner_cpu", inner_cpu, -1);
+        pnh.param("deterministic", deterministic, false);
+        pnh.param("deterministic/cpu", deterministic_cpu, 0);
+        int steps;
+        pnh.param("deterministic/steps", steps, 0);
+        deterministic_steps = std::max(steps, 0);
+        pnh.param("deterministic/target", deterministic_target, std::vector<double>());
+
+        double accel_noise, position_noise, velocity_noise, max_gap;
+        pnh.param("estimator/accel_noise", accel_noise, 5.0);
+        pnh.param("estimator/position_noise", position_noise, 1e-4);
+        pnh.param("estimator/velocity_noise", velocity_noise, 2e-2);
+        pnh.param("estimator/max_gap", max_gap, 0.1);
+        estimator = std::make_unique<casadi_mpc_template::JointStateEstimator>(6, accel_noise, position_noise,
+                                                                               velocity_noise, max_gap);
     }
 
     void joint_states_callback(const sensor_msgs::JointState::ConstPtr &JointState) // FIXED
     {
+        loop_metrics.joint_states->inc();
 
         q[0] = JointState->position[2];
         q[1] = JointState->position[1];
@@ -40,11 +153,24 @@ class MotionPlanner
         q_dot[4] = JointState->velocity[4];
         q_dot[5] = JointState->velocity[5];
 
-        x << q, q_dot;
+        double stamp = JointState->header.stamp.isZero() ? ros::Time::now().toSec() : JointState->header.stamp.toSec();
+        NMPC_TRACE(joint_state, static_cast<int64_t>(stamp * 1e9));
+        if (!estimator->update(stamp, q, q_dot))
+        {
+            loop_metrics.rejected_states->inc();
+            NMPC_TRACE(joint_state_rejected, estimator->rejected());
+            ROS_WARN_THROTTLE(1.0, "Dropped out-of-order joint state (%zu so far)", estimator->rejected());
+        }
     }
 
     void target_states_callback(const gazebo_msgs::ModelStates::ConstPtr &ModelState)
     {
+        loop_metrics.targets->inc();
+        NMPC_TRACE(model_states);
+        if (reference_latched)
+        {
+            return;
+        }
         for (int i = 0; i < ModelState->name.size(); i++)
         {
 
@@ -55,8 +181,11 @@ class MotionPlanner
                 target_pose.position.y = ModelState->pose[i].position.y;
                 target_pose.position.z = ModelState->pose[i].position.z;
                 target_pose.orientation = ModelState->pose[i].orientation;
+                target_velocity << ModelState->twist[i].linear.x, ModelState->twist[i].linear.y,
+                    ModelState->twist[i].linear.z;
             }
         }
+        std::lock_guard<std::mutex> lock(ref_mtx);
         position_ref << target_pose.position.x, target_pose.position.y, target_pose.position.z;
         orientation_ref.w() = target_pose.orientation.w;
         orientation_ref.x() = target_pose.orientation.x;
@@ -68,53 +197,305 @@ class MotionPlanner
     {
         using namespace casadi_mpc_template;
 
-        auto prob = std::make_shared<MotionPlanningProb>(Problem::DynamicsType::ContinuesRK4, 12, 6, 10, dt);
+        if (hierarchical)
+        {
+            run_hierarchical();
+            return;
+        }
+
+        auto prob = make_problem(spec.horizon, dt);
+
+        // the target reference is a solver parameter, so the solver is built once and warm started every tick
+        MPC *mpc = nullptr;
+        std::vector<std::unique_ptr<MPC>> mpcs;
+        std::vector<ProblemSpec> mpc_specs; // problem of each level, stored with a failure for nmpc_diagnose
+        std::unique_ptr<BackendSwitchingPolicy> switching;
+        std::unique_ptr<ScenarioMPC> scenario_mpc;
+        if (num_scenarios > 1)
+        {
+            // serial evaluation keeps the scenario order and the reductions over scenarios fixed
+            scenario_mpc = std::make_unique<ScenarioMPC>(prob, num_scenarios, std::vector<double>{}, "ipopt",
+                                                         ScenarioMPC::default_config(),
+                                                         deterministic ? "serial" : "thread");
+        }
+        else if (switching_enabled && !deterministic && !switching_levels.empty())
+        {
+            // all levels are built up front, a switch only transfers the warm start
+            for (size_t i = 0; i < switching_levels.size(); i++)
+            {
+                ProblemSpec s = spec;
+                s.backend = switching_levels[i];
+                s.rti = s.backend.compare(0, 4, "rti-") == 0;
+                if (s.rti)
+                {
+                    s.backend = s.backend.substr(4);
+                }
+                if (i < switching_horizons.size() && switching_horizons[i] > 0)
+                {
+                    s.horizon = switching_horizons[i];
+                }
+                mpcs.push_back(build_mpc(s, s.make_problem()));
+                mpc_specs.push_back(s);
+                ROS_INFO_STREAM("Solver level " << i << ": " << switching_levels[i] << ", horizon " << s.horizon);
+            }
+            switching_config.deadline = dt;
+            switching =
+                std::make_unique<BackendSwitchingPolicy>(mpcs.size(), switching_initial_level, switching_config);
+        }
+        else
+        {
+            mpcs.push_back(make_mpc(prob));
+            mpc_specs.push_back(problem_spec(prob->horizon(), prob->dt()));
+        }
+        for (auto &level : mpcs)
+        {
+            level->set_shift_warm_start(shift_warm_start);
+            level->set_initial_state_policy(parse_initial_state_policy(), initial_state_soft_weight);
+        }
+        if (!mpcs.empty())
+        {
+            mpc = mpcs[switching ? switching->level() : 0].get();
+            loop_metrics.solver_level->set(switching ? switching->level() : 0);
+        }
 
-        Eigen::VectorXd u_lb = (Eigen::VectorXd(6) << -5.0, -5.0, -5.0, -5.0, -5.0, -5.0).finished();
-        Eigen::VectorXd u_Ub = (Eigen::VectorXd(6) << 5.0, 5.0, 5.0, 5.0, 5.0, 5.0).finished();
-        Eigen::VectorXd x_lb = (Eigen::VectorXd(12) << joint_pose_lower_limit, joint_vel_lower_limit).finished();
-        Eigen::VectorXd x_Ub = (Eigen::VectorXd(12) << joint_pose_upper_limit, joint_vel_upper_limit).finished();
+        // point-to-point moves: a time-optimal reach planned in the background is tracked instead of the raw target
+        std::unique_ptr<TimeOptimalPlanner> move_planner;
+        if (time_optimal)
+        {
+            move_planner = std::make_unique<TimeOptimalPlanner>(prob);
+        }
+        Eigen::Vector3d move_target = Eigen::Vector3d::Constant(std::numeric_limits<double>::quiet_NaN());
+        size_t move_id = 0;
+        double move_start = -1;
+        std::shared_ptr<const TimeOptimalPlanner::Trajectory> move;
+
+        // Deterministic mode: virtual clock (tick * dt), the state is propagated by the model instead of measured, the
+        // target is fixed, the loop is pinned to one CPU and background planning is done inline, so two runs give
+        // bit-identical trajectories and solve times only differ by the code
+        if (deterministic)
+        {
+            if (!set_current_thread_affinity(deterministic_cpu))
+            {
+                ROS_WARN_STREAM("Could not pin the control loop to CPU " << deterministic_cpu);
+            }
+            if (deterministic_target.size() == 7)
+            {
+                position_ref << deterministic_target[0], deterministic_target[1], deterministic_target[2];
+                orientation_ref = Eigen::Quaterniond(deterministic_target[3], deterministic_target[4],
+                                                     deterministic_target[5], deterministic_target[6]);
+            }
+            else
+            {
+                // first received target
+                while (ros::ok() && position_ref.isZero())
+                {
+                    ros::spinOnce();
+                    ros::Duration(0.01).sleep();
+                }
+            }
+            // later model states must not move the target, the callbacks run in this thread (spinOnce)
+            reference_latched = true;
+        }
+        auto watchdog = make_watchdog();
+        auto shadow = make_shadow_solver();
+        auto exporter = make_metrics_exporter();
+        size_t shadow_dropped = 0;
 
-        prob->set_input_bound(u_lb, u_Ub);
-        prob->set_state_bound(x_lb, x_Ub);
+        size_t tick = 0;
+        auto now = [&]() { return deterministic ? tick * dt : ros::Time::now().toSec(); };
+        uint64_t trajectory_hash = 1469598103934665603ull;
 
         auto t_all_start = std::chrono::system_clock::now();
 
-        while (ros::ok())
-        {
+        auto finished = [&]() { return deterministic && deterministic_steps > 0 && tick >= deterministic_steps; };
 
-            prob->x_quat_ref = {orientation_ref.w(), orientation_ref.x(), orientation_ref.y(), orientation_ref.z()};
-            prob->x_pose_ref = {position_ref(0), position_ref(1), position_ref(2)};
+        while (ros::ok() && !finished())
+        {
+            auto t_start = std::chrono::steady_clock::now();
+            const uint64_t allocations_start = allocation_count();
+            const uint64_t trace_tick = solve_stats.count();
+            NMPC_TRACE(tick_start, trace_tick);
 
-            MPC mpc(prob);
+            // filtered state predicted to the solve start
+            if (!deterministic && estimator->initialized())
+            {
+                x = estimator->predict(now());
+            }
 
-            auto t_start = std::chrono::system_clock::now();
+            Eigen::VectorXd p = MotionPlanningProb::reference_parameter(position_ref, orientation_ref);
+            if (move_planner)
+            {
+                if (!((position_ref - move_target).norm() < 1e-3))
+                {
+                    move_target = position_ref;
+                    move_start = -1;
+                    if (deterministic)
+                    {
+                        move = move_planner->plan(x, p);
+                    }
+                    else
+                    {
+                        move_id = move_planner->request(x, p);
+                        move = nullptr;
+                    }
+                }
+                if (!deterministic && move_planner->latest_id() == move_id)
+                {
+                    move = move_planner->latest();
+                }
+                if (move)
+                {
+                    if (move_start < 0)
+                    {
+                        move_start = now();
+                    }
+                    p = move->reference_parameter(now() - move_start);
+                }
+            }
 
             // Solve for optimal input using MPC
-            Eigen::VectorXd u = mpc.solve(x);
+            Eigen::VectorXd u;
+            int iterations = 0;
+            if (scenario_mpc)
+            {
+                NMPC_TRACE(solve_start, trace_tick);
+                u = scenario_mpc->solve(x, target_scenarios(prob->horizon() * dt));
+                iterations = scenario_mpc->iterations();
+                NMPC_TRACE(solve_end, trace_tick, static_cast<int>(scenario_mpc->status()), iterations);
+                if (scenario_mpc->status() == SolveStatus::InvalidInput ||
+                    scenario_mpc->status() == SolveStatus::InvalidSolution)
+                {
+                    NMPC_TRACE(solve_fallback, trace_tick, static_cast<int>(scenario_mpc->status()),
+                               scenario_mpc->consecutive_failures());
+                    ROS_WARN_STREAM_THROTTLE(1.0, "Scenario solve failed (" << to_string(scenario_mpc->status())
+                                                                            << "), following the last good plan for "
+                                                                            << scenario_mpc->consecutive_failures()
+                                                                            << " ticks");
+                }
+            }
+            else
+            {
+                NMPC_TRACE(solve_start, trace_tick);
+                u = mpc->solve(x, p);
+                iterations = mpc->iterations();
+                NMPC_TRACE(solve_end, trace_tick, static_cast<int>(mpc->status()), iterations);
+                if (!mpc->initial_state_violations().empty())
+                {
+                    std::ostringstream components;
+                    for (size_t l : mpc->initial_state_violations())
+                    {
+                        components << " " << l << " (" << x[l] << ")";
+                    }
+                    ROS_WARN_STREAM_THROTTLE(1.0, "Initial state outside the bounds, " << initial_state_policy
+                                                                                        << ":" << components.str());
+                }
+                if (mpc->status() == SolveStatus::InvalidInput || mpc->status() == SolveStatus::InvalidSolution)
+                {
+                    NMPC_TRACE(solve_fallback, trace_tick, static_cast<int>(mpc->status()),
+                               mpc->consecutive_failures());
+                    ROS_WARN_STREAM_THROTTLE(1.0, "Solve failed (" << to_string(mpc->status())
+                                                                   << "), following the last good plan for "
+                                                                   << mpc->consecutive_failures() << " ticks");
+                    if (!diagnostics_file.empty() && mpc->consecutive_failures() == 1)
+                    {
+                        FailurePoint point = mpc->failure_point();
+                        size_t level = switching ? switching->level() : 0;
+                        point.problem = mpc_specs[level].canonical();
+                        point.save(diagnostics_file);
+                    }
+                }
+            }
 
             Eigen::VectorXd x_sim = prob->discretized_dynamics(dt, x, u);
 
-            q_dot_desired += u * dt;
+            // the watchdog follows the rest of a good plan before it brakes, a failed solve leaves it only braking
+            std::vector<Eigen::VectorXd> plan;
+            if (mpc && (mpc->status() == SolveStatus::Success || mpc->status() == SolveStatus::NotConverged))
+            {
+                plan = mpc->input_trajectory();
+            }
+            Eigen::VectorXd command;
+            {
+                std::lock_guard<std::mutex> lock(command_mtx);
+                q_dot_desired += u * dt;
+                command = q_dot_desired;
+                planned_inputs.swap(plan);
+                planned_dt = dt;
+                planned_stamp = t_start;
+            }
+            estimator->set_acceleration(u);
 
-            auto t_end = std::chrono::system_clock::now();
+            auto t_end = std::chrono::steady_clock::now();
 
             double solve_time = std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count() * 1e-6;
             std::cout << "Solve time: " << solve_time << std::endl;
 
+            solve_stats.add(solve_time, iterations);
+
+            const uint64_t allocations = allocation_count() - allocations_start;
+            loop_metrics.ticks->inc();
+            loop_metrics.tick_time->observe(solve_time);
+            loop_metrics.iterations->observe(iterations);
+            loop_metrics.allocations->inc(allocations);
+            loop_metrics.tick_allocations->set(allocations);
+            if (solve_time > dt)
+            {
+                loop_metrics.deadline_misses->inc();
+            }
+            loop_metrics.solves[static_cast<int>(scenario_mpc ? scenario_mpc->status() : mpc->status())]->inc();
+            if (switching)
+            {
+                MPC *next = mpcs[switching->update(solve_time, iterations)].get();
+                if (next != mpc)
+                {
+                    next->set_warm_start(mpc->state_trajectory(), mpc->input_trajectory(), dt);
+                    mpc = next;
+                    loop_metrics.solver_level->set(switching->level());
+                    NMPC_TRACE(solver_switch, trace_tick, switching->level());
+                    ROS_INFO_STREAM("Switched to solver level " << switching->level() << " ("
+                                                                << switching_levels[switching->level()] << ")");
+                }
+            }
+            if (shadow)
+            {
+                shadow->submit({now(), x, p, u, solve_time, iterations});
+                size_t dropped = shadow->dropped();
+                loop_metrics.shadow_dropped->inc(dropped - shadow_dropped);
+                shadow_dropped = dropped;
+            }
+            if (solve_stats.count() % 500 == 0)
+            {
+                ROS_INFO_STREAM(solve_stats.summary());
+                if (shadow)
+                {
+                    ROS_INFO_STREAM("Shadow solver\n" << shadow->summary());
+                }
+            }
+
+            if (deterministic)
+            {
+                x = x_sim;
+                tick++;
+                // FNV-1a over the bits of the simulated states, equal hashes mean bit-identical trajectories
+                for (int i = 0; i < x.size(); i++)
+                {
+                    uint64_t bits;
+                    std::memcpy(&bits, x.data() + i, sizeof(bits));
+                    trajectory_hash = (trajectory_hash ^ bits) * 1099511628211ull;
+                }
+            }
+
             std::cout << "state: " << std::endl << x.transpose() << std::endl;
             std::cout << "input: " << std::endl << u.transpose() << std::endl;
-            std::cout << "velocity: " << std::endl << q_dot_desired.transpose() << std::endl;
+            std::cout << "velocity: " << std::endl << command.transpose() << std::endl;
             // std::cout << "x_sim: " << std::endl << x_sim.transpose() << std::endl;
 
-            std_msgs::Float64MultiArray joint_vel_command;
-            for (int i = 0; i < q_dot_desired.size(); ++i)
+            // the deterministic loop runs on the model, it never commands the robot
+            if (!deterministic)
             {
-                joint_vel_command.data.push_back(q_dot_desired(i));
+                publish_velocity_command(command);
             }
 
-            joint_vel_command_pub.publish(joint_vel_command);
-
             std_msgs::Float64MultiArray input;
             for (int i = 0; i < u.size(); ++i)
             {
@@ -122,13 +503,356 @@ class MotionPlanner
             }
 
             input_pub.publish(input);
+            NMPC_TRACE(publish, trace_tick);
+
+            if (watchdog)
+            {
+                watchdog->heartbeat();
+                export_watchdog_overruns(*watchdog);
+            }
 
             ros::spinOnce();
             // loop_rate.sleep();
         }
+
+        if (deterministic)
+        {
+            ROS_INFO_STREAM("Deterministic run: " << tick << " ticks, trajectory hash " << std::hex << trajectory_hash
+                                                  << std::dec << ", " << solve_stats.summary());
+        }
+    }
+
+    void run_hierarchical()
+    {
+        using namespace casadi_mpc_template;
+
+        auto outer_prob = make_problem(outer_horizon, outer_dt);
+        auto outer = make_mpc(outer_prob);
+        outer->set_shift_warm_start(shift_warm_start);
+
+        auto limits = MotionPlanningProb::ur20_joint_limits();
+        auto inner_prob = std::make_shared<JointTrackingProb>(6, inner_horizon, 1.0 / inner_rate);
+        inner_prob->set_input_bound(Eigen::VectorXd::Constant(6, -5.0), Eigen::VectorXd::Constant(6, 5.0));
+        inner_prob->set_state_bound((Eigen::VectorXd(12) << limits.pos_lower, limits.vel_lower).finished(),
+                                    (Eigen::VectorXd(12) << limits.pos_upper, limits.vel_upper).finished());
+        auto inner = std::make_unique<MPC>(inner_prob, "sqpmethod", MPC::rti_config(MPC::default_qpoases_config()));
+        inner->set_shift_warm_start(true);
+        inner->set_initial_state_policy(parse_initial_state_policy(), initial_state_soft_weight);
+
+        auto watchdog = make_watchdog();
+        const double inner_dt = inner_prob->dt();
+
+        HierarchicalPlanner::Callbacks callbacks;
+        callbacks.clock = []() { return ros::Time::now().toSec(); };
+        callbacks.state = [this](double t) {
+            return estimator->initialized() ? estimator->predict(t) : (Eigen::VectorXd(12) << q, q_dot).finished();
+        };
+        callbacks.reference = [this]() {
+            std::lock_guard<std::mutex> lock(ref_mtx);
+            return MotionPlanningProb::reference_parameter(position_ref, orientation_ref);
+        };
+        callbacks.command = [&](const Eigen::VectorXd &u, double) {
+            Eigen::VectorXd command;
+            {
+                std::lock_guard<std::mutex> lock(command_mtx);
+                q_dot_desired += u * inner_dt;
+                command = q_dot_desired;
+            }
+            estimator->set_acceleration(u);
+            publish_velocity_command(command);
+            if (watchdog)
+            {
+                watchdog->heartbeat();
+                export_watchdog_overruns(*watchdog);
+            }
+        };
+
+        HierarchicalPlanner::Config config;
+        config.outer_rate = outer_rate;
+        config.inner_rate = inner_rate;
+        config.outer_cpu = outer_cpu;
+        config.inner_cpu = inner_cpu;
+        HierarchicalPlanner planner(std::move(outer), outer_dt, std::move(inner), inner_prob, callbacks, config);
+        planner.start();
+
+        // callbacks only, the loops run on their own threads
+        ros::Time last_summary = ros::Time::now();
+        while (ros::ok())
+        {
+            ros::spinOnce();
+            ros::Duration(0.001).sleep();
+            if ((ros::Time::now() - last_summary).toSec() > 5.0)
+            {
+                ROS_INFO_STREAM(planner.summary());
+                last_summary = ros::Time::now();
+            }
+        }
+        planner.stop();
     }
 
   private:
+    // the problem of spec with another horizon and step (outer loop of the hierarchical mode)
+    std::shared_ptr<casadi_mpc_template::MotionPlanningProb> make_problem(size_t horizon, double step)
+    {
+        return problem_spec(horizon, step).make_problem();
+    }
+
+    casadi_mpc_template::ProblemSpec problem_spec(size_t horizon, double step) const
+    {
+        casadi_mpc_template::ProblemSpec s = spec;
+        s.horizon = horizon;
+        s.dt = step;
+        return s;
+    }
+
+    // independent of the solver: if a tick overruns its deadline the last velocity command is ramped down to zero
+    std::unique_ptr<casadi_mpc_template::Watchdog> make_watchdog()
+    {
+        using casadi_mpc_template::Watchdog;
+        if (!watchdog_enabled || deterministic)
+        {
+            return nullptr;
+        }
+        watchdog_overruns_exported = 0;
+        auto watchdog = std::make_unique<Watchdog>(
+            watchdog_deadline, watchdog_period, [this](double elapsed) { decelerate(elapsed); }, watchdog_cpu,
+            watchdog_priority);
+        if (!watchdog->realtime_ok())
+        {
+            ROS_WARN("Watchdog thread runs without real-time priority");
+        }
+        return watchdog;
+    }
+
+    // candidate configuration evaluated next to the production solver, see ShadowSolver
+    std::unique_ptr<casadi_mpc_template::ShadowSolver> make_shadow_solver()
+    {
+        using namespace casadi_mpc_template;
+        if (!shadow_enabled)
+        {
+            return nullptr;
+        }
+        try
+        {
+            ProblemSpec s = problem_spec(shadow_horizon > 0 ? shadow_horizon : spec.horizon, dt);
+            s.backend = shadow_solver;
+            s.rti = shadow_rti;
+            SolverProfile profile =
+                shadow_solver_profile.empty() ? s.solver_profile() : load_solver_profile(shadow_solver_profile);
+            auto candidate = std::make_unique<MPC>(s.make_problem(), profile.solver, profile.options);
+            candidate->set_shift_warm_start(shift_warm_start);
+            candidate->set_initial_state_policy(parse_initial_state_policy(), initial_state_soft_weight);
+            ROS_INFO_STREAM("Shadow solver " << profile.solver << ", horizon " << s.horizon << ", logging to "
+                                             << shadow_log_file);
+            return std::make_unique<ShadowSolver>(std::move(candidate), shadow_log_file, shadow_cpu);
+        }
+        catch (const std::exception &e)
+        {
+            ROS_ERROR_STREAM("Shadow solver disabled: " << e.what());
+            return nullptr;
+        }
+    }
+
+    void register_metrics()
+    {
+        using casadi_mpc_template::MetricsRegistry;
+        using casadi_mpc_template::SolveStatus;
+        auto &m = loop_metrics;
+        m.tick_time = &metrics->histogram("nmpc_tick_seconds", "Control loop compute time per tick (solve and command)",
+                                          MetricsRegistry::latency_buckets());
+        m.iterations = &metrics->histogram("nmpc_solver_iterations", "Solver iterations per tick",
+                                           {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 3000});
+        m.ticks = &metrics->counter("nmpc_ticks_total", "Control loop ticks");
+        m.deadline_misses = &metrics->counter("nmpc_deadline_misses_total", "Ticks with a compute time above dt");
+        for (SolveStatus status : {SolveStatus::Success, SolveStatus::NotConverged, SolveStatus::InvalidInput,
+                                   SolveStatus::InvalidSolution})
+        {
+            std::string label = to_string(status);
+            std::replace(label.begin(), label.end(), ' ', '_');
+            m.solves[static_cast<int>(status)] =
+                &metrics->counter("nmpc_solves_total", "MPC solves by result", "status=\"" + label + "\"");
+        }
+        m.allocations =
+            &metrics->counter("nmpc_allocations_total", "Heap allocations of the control loop thread in its ticks");
+        m.tick_allocations = &metrics->gauge("nmpc_tick_allocations", "Heap allocations in the last tick");
+        m.watchdog_overruns =
+            &metrics->counter("nmpc_watchdog_overruns_total", "Deadline overruns caught by the watchdog");
+        m.joint_states = &metrics->counter("nmpc_callbacks_total", "Received messages", "callback=\"joint_states\"");
+        m.targets = &metrics->counter("nmpc_callbacks_total", "Received messages", "callback=\"model_states\"");
+        m.rejected_states =
+            &metrics->counter("nmpc_rejected_joint_states_total", "Out-of-order joint states dropped by the estimator");
+        m.shadow_dropped =
+            &metrics->counter("nmpc_shadow_dropped_total", "Ticks replaced in the shadow solver queue before a solve");
+        m.solver_level = &metrics->gauge("nmpc_solver_level", "Active level of the backend switching");
+    }
+
+    std::unique_ptr<casadi_mpc_template::MetricsExporter> make_metrics_exporter()
+    {
+        if (!metrics_enabled)
+        {
+            return nullptr;
+        }
+        try
+        {
+            auto exporter =
+                std::make_unique<casadi_mpc_template::MetricsExporter>(metrics, metrics_port, metrics_socket);
+            if (metrics_socket.empty())
+            {
+                ROS_INFO_STREAM("Serving metrics on http://127.0.0.1:" << exporter->port() << "/metrics");
+            }
+            else
+            {
+                ROS_INFO_STREAM("Serving metrics on " << metrics_socket);
+            }
+            return exporter;
+        }
+        catch (const std::exception &e)
+        {
+            ROS_ERROR_STREAM("Metrics exporter disabled: " << e.what());
+            return nullptr;
+        }
+    }
+
+    void publish_velocity_command(const Eigen::VectorXd &command)
+    {
+        std_msgs::Float64MultiArray joint_vel_command;
+        for (int i = 0; i < command.size(); ++i)
+        {
+            joint_vel_command.data.push_back(command(i));
+        }
+        joint_vel_command_pub.publish(joint_vel_command);
+    }
+
+    // watchdog thread: integrate the inputs of the last plan on its own time line (input k from k * dt after the tick
+    // that solved it), then scale the command down along its direction, the fastest joint at watchdog_deceleration
+    void decelerate(double elapsed)
+    {
+        NMPC_TRACE(watchdog_overrun, static_cast<int64_t>(elapsed * 1e6));
+        Eigen::VectorXd command;
+        {
+            std::lock_guard<std::mutex> lock(command_mtx);
+            double age = std::chrono::duration<double>(std::chrono::steady_clock::now() - planned_stamp).count();
+            size_t k = planned_dt > 0 ? static_cast<size_t>(std::max(0.0, age) / planned_dt) : planned_inputs.size();
+            if (k < planned_inputs.size())
+            {
+                q_dot_desired += planned_inputs[k] * watchdog_period;
+            }
+            else
+            {
+                double speed = q_dot_desired.cwiseAbs().maxCoeff();
+                if (speed > 0)
+                {
+                    q_dot_desired *= std::max(0.0, speed - watchdog_deceleration * watchdog_period) / speed;
+                }
+            }
+            command = q_dot_desired;
+        }
+        publish_velocity_command(command);
+        ROS_WARN_STREAM_THROTTLE(1.0, "Control loop missed its deadline (" << elapsed << " s since the last tick), "
+                                                                           << "decelerating");
+    }
+
+    // Watchdog::overruns() counts a streak of missed heartbeats once, the counter catches up when the loop is back
+    void export_watchdog_overruns(const casadi_mpc_template::Watchdog &watchdog)
+    {
+        const size_t overruns = watchdog.overruns();
+        loop_metrics.watchdog_overruns->inc(overruns - watchdog_overruns_exported);
+        watchdog_overruns_exported = overruns;
+    }
+
+    casadi_mpc_template::InitialStatePolicy parse_initial_state_policy() const
+    {
+        using casadi_mpc_template::InitialStatePolicy;
+        if (initial_state_policy == "pin")
+        {
+            return InitialStatePolicy::Pin;
+        }
+        if (initial_state_policy == "project")
+        {
+            return InitialStatePolicy::Project;
+        }
+        if (initial_state_policy == "soft")
+        {
+            return InitialStatePolicy::Soft;
+        }
+        if (initial_state_policy != "relax")
+        {
+            ROS_WARN_STREAM("Unknown initial state policy " << initial_state_policy << ", using relax");
+        }
+        return InitialStatePolicy::Relax;
+    }
+
+    // solver backends: a profile written by nmpc_autotune, or the backend of the spec (ipopt, or sqpmethod with
+    // qpoases/hpipm/osqp)
+    std::unique_ptr<casadi_mpc_template::MPC> make_mpc(std::shared_ptr<casadi_mpc_template::MotionPlanningProb> prob)
+    {
+        using namespace casadi_mpc_template;
+        if (!solver_profile.empty())
+        {
+            try
+            {
+                SolverProfile profile = load_solver_profile(solver_profile);
+                ROS_INFO_STREAM("Using solver profile " << solver_profile << " (" << profile.solver << ")");
+                return std::make_unique<MPC>(prob, profile.solver, profile.options);
+            }
+            catch (const std::exception &e)
+            {
+                ROS_WARN_STREAM("Ignoring solver profile: " << e.what());
+            }
+        }
+        return build_mpc(problem_spec(prob->horizon(), prob->dt()), prob);
+    }
+
+    // the solver of the spec backend, loaded from ~solver_cache_dir if it was built before
+    std::unique_ptr<casadi_mpc_template::MPC> build_mpc(casadi_mpc_template::ProblemSpec s,
+                                                        std::shared_ptr<casadi_mpc_template::MotionPlanningProb> prob)
+    {
+        using namespace casadi_mpc_template;
+        SolverProfile profile;
+        try
+        {
+            profile = s.solver_profile();
+        }
+        catch (const std::exception &e)
+        {
+            ROS_WARN_STREAM(e.what() << ", using ipopt");
+            s.backend = "ipopt";
+            profile = s.solver_profile();
+        }
+        std::string cache;
+        if (!solver_cache_dir.empty())
+        {
+            try
+            {
+                cache = s.solver_cache_file(solver_cache_dir);
+            }
+            catch (const std::exception &e)
+            {
+                ROS_WARN_STREAM("Solver cache disabled: " << e.what());
+            }
+        }
+        auto mpc = std::make_unique<MPC>(prob, profile.solver, profile.options, cache);
+        if (!cache.empty())
+        {
+            ROS_INFO_STREAM((mpc->solver_from_cache() ? "Loaded solver from " : "Built solver, cached in ")
+                            << mpc->solver_cache_file());
+        }
+        return mpc;
+    }
+
+    // target predictions over the horizon: the target keeps still, moves with its current velocity or overshoots it
+    std::vector<Eigen::VectorXd> target_scenarios(double horizon_time) const
+    {
+        std::vector<Eigen::VectorXd> params;
+        for (int s = 0; s < num_scenarios; s++)
+        {
+            double scale = 2.0 * s / (num_scenarios - 1);
+            Eigen::Vector3d position = position_ref + scale * horizon_time * target_velocity;
+            params.push_back(casadi_mpc_template::MotionPlanningProb::reference_parameter(position, orientation_ref));
+        }
+        return params;
+    }
+
     ros::NodeHandle nh_;
     ros::Subscriber joint_state_sub;
     ros::Subscriber target_state_sub;
@@ -137,20 +861,83 @@ class MotionPlanner
 
     geometry_msgs::Pose target_pose;
 
-    const double dt = 0.01;
+    std::unique_ptr<casadi_mpc_template::JointStateEstimator> estimator;
+
+    // OCP and solver backend, from the params or ~problem_spec
+    casadi_mpc_template::ProblemSpec spec;
+    std::string solver_cache_dir;
+    double dt = 0.01;
+    int num_scenarios = 1;
+    bool shift_warm_start = true;
+    std::string solver_profile;
+    std::string diagnostics_file;
+    std::string initial_state_policy = "relax";
+    double initial_state_soft_weight = 1e3;
+    bool watchdog_enabled = true;
+    double watchdog_deadline = 0.1;
+    double watchdog_period = 0.002;
+    double watchdog_deceleration = 5.0;
+    int watchdog_cpu = -1;
+    int watchdog_priority = 0;
+    bool shadow_enabled = false;
+    std::string shadow_solver = "ipopt";
+    bool shadow_rti = false;
+    int shadow_horizon = 0;
+    std::string shadow_solver_profile;
+    int shadow_cpu = -1;
+    std::string shadow_log_file = "nmpc_shadow.csv";
+    bool switching_enabled = false;
+    std::vector<std::string> switching_levels;
+    std::vector<int> switching_horizons;
+    size_t switching_initial_level = 0;
+    casadi_mpc_template::BackendSwitchingPolicy::Config switching_config;
+    bool metrics_enabled = false;
+    int metrics_port = 9464;
+    std::string metrics_socket;
+    bool hierarchical = false;
+    double outer_dt = 0.05;
+    int outer_horizon = 40;
+    int inner_horizon = 10;
+    double outer_rate = 10.0;
+    double inner_rate = 200.0;
+    int outer_cpu = -1;
+    int inner_cpu = -1;
+    bool deterministic = false;
+    bool reference_latched = false;
+    int deterministic_cpu = 0;
+    size_t deterministic_steps = 0;
+    std::vector<double> deterministic_target;
+    bool time_optimal = false;
+
+    casadi_mpc_template::SolveStatistics solve_stats;
+
+    // registered in the constructor and updated whether or not the exporter runs
+    std::shared_ptr<casadi_mpc_template::MetricsRegistry> metrics =
+        std::make_shared<casadi_mpc_template::MetricsRegistry>();
+    struct LoopMetrics
+    {
+        casadi_mpc_template::MetricsRegistry::Histogram *tick_time, *iterations;
+        casadi_mpc_template::MetricsRegistry::Counter *ticks, *deadline_misses, *solves[4], *allocations,
+            *watchdog_overruns, *joint_states, *targets, *rejected_states, *shadow_dropped;
+        casadi_mpc_template::MetricsRegistry::Gauge *tick_allocations, *solver_level;
+    } loop_metrics;
 
     Eigen::VectorXd q = Eigen::VectorXd::Zero(6);
     Eigen::VectorXd q_dot = Eigen::VectorXd::Zero(6);
+    // commanded joint velocities and the inputs of the last good plan, shared with the watchdog thread
+    std::mutex command_mtx;
     Eigen::VectorXd q_dot_desired = Eigen::VectorXd::Zero(6);
-
-    Eigen::VectorXd joint_pose_lower_limit = Eigen::VectorXd::Zero(6);
-    Eigen::VectorXd joint_pose_upper_limit = Eigen::VectorXd::Zero(6);
-    Eigen::VectorXd joint_vel_lower_limit = Eigen::VectorXd::Zero(6);
-    Eigen::VectorXd joint_vel_upper_limit = Eigen::VectorXd::Zero(6);
+    std::vector<Eigen::VectorXd> planned_inputs;
+    double planned_dt = 0.0;
+    std::chrono::steady_clock::time_point planned_stamp;
+    size_t watchdog_overruns_exported = 0;
 
     Eigen::VectorXd x = Eigen::VectorXd::Zero(12);
 
-    Eigen::VectorXd position_ref = Eigen::VectorXd::Zero(3);
+    // target reference, shared with the outer loop thread in hierarchical mode
+    std::mutex ref_mtx;
+    Eigen::Vector3d position_ref = Eigen::Vector3d::Zero();
+    Eigen::Vector3d target_velocity = Eigen::Vector3d::Zero();
     Eigen::Quaterniond orientation_ref = Eigen::Quaterniond::Identity();
 };
 
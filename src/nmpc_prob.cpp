@@ -9,21 +9,59 @@ MotionPlanningProb::MotionPlanningProb(DynamicsType dynamics_type, int state_dim
     using namespace casadi;
     Q_trans = DM::diag({800.0, 800.0, 800.0});
     Q_ori = DM::diag({500.0, 500.0, 500.0});
-    Q_vel = DM::diag({10, 10, 10, 10, 10, 10});
-    R = DM::diag({0.01, 0.01, 0.01, 0.01, 0.01, 0.01});
+    Q_vel = 10 * DM::eye(control_dim);
+    R = 0.01 * DM::eye(control_dim);
+
+    set_parameter_dim(7);
 }
 
-casadi::MX MotionPlanningProb::dynamics(casadi::MX x, casadi::MX u)
+MotionPlanningProb::JointLimits MotionPlanningProb::ur20_joint_limits()
 {
-    using namespace casadi;
+    JointLimits limits;
+    limits.pos_lower = (Eigen::VectorXd(6) << -6.283185307179586, -6.283185307179586, -3.141592653589793,
+                        -6.283185307179586, -6.283185307179586, -6.283185307179586)
+                           .finished();
+    limits.pos_upper = -limits.pos_lower;
+    limits.vel_lower = (Eigen::VectorXd(6) << -2.0943951023931953, -2.0943951023931953, -2.6179938779914944,
+                        -3.6651914291880923, -3.6651914291880923, -3.6651914291880923)
+                           .finished();
+    limits.vel_upper = -limits.vel_lower;
+    return limits;
+}
 
-    MX A_c = MX::zeros(12, 12);
-    A_c(Slice(0, 6), Slice(6, 12)) = MX::eye(6);
+void MotionPlanningProb::set_ur20_bounds(double accel_limit)
+{
+    auto limits = ur20_joint_limits();
+    Eigen::VectorXd x_lb = (Eigen::VectorXd(12) << limits.pos_lower, limits.vel_lower).finished();
+    Eigen::VectorXd x_ub = (Eigen::VectorXd(12) << limits.pos_upper, limits.vel_upper).finished();
+    set_input_bound(Eigen::VectorXd::Constant(6, -accel_limit), Eigen::VectorXd::Constant(6, accel_limit));
+    set_state_bound(x_lb, x_ub);
+}
+
+Eigen::VectorXd MotionPlanningProb::reference_parameter(const Eigen::Vector3d &position,
+                                                        const Eigen::Quaterniond &orientation)
+{
+    Eigen::VectorXd p(7);
+    p << position, orientation.w(), orientation.x(), orientation.y(), orientation.z();
+    return p;
+}
 
-    MX B_c = MX::zeros(12, 6);
-    B_c(Slice(6, 12), Slice(0, 6)) = MX::eye(6);
+casadi::MX MotionPlanningProb::x_pose_ref() const
+{
+    return parameter()(casadi::Slice(0, 3));
+}
+
+casadi::MX MotionPlanningProb::x_quat_ref() const
+{
+    return parameter()(casadi::Slice(3, 7));
+}
+
+casadi::MX MotionPlanningProb::dynamics(casadi::MX x, casadi::MX u)
+{
+    using namespace casadi;
 
-    MX x_dot = mtimes(A_c, x) + mtimes(B_c, u);
+    // q_ddot = u for every joint, x = [q; q_dot]
+    MX x_dot = MX::vertcat({x(Slice(nu(), nx())), u});
 
     return x_dot;
 }
@@ -33,11 +71,12 @@ Eigen::VectorXd MotionPlanningProb::discretized_dynamics(double dt, Eigen::Vecto
     auto dynamics = [&](Eigen::VectorXd x, Eigen::VectorXd u) -> Eigen::VectorXd {
         using namespace casadi;
 
-        Eigen::MatrixXd A_c = Eigen::MatrixXd::Zero(12, 12);
-        A_c.block<6, 6>(0, 6) = Eigen::MatrixXd::Identity(6, 6);
+        const int nq = u.size();
+        Eigen::MatrixXd A_c = Eigen::MatrixXd::Zero(2 * nq, 2 * nq);
+        A_c.block(0, nq, nq, nq) = Eigen::MatrixXd::Identity(nq, nq);
 
-        Eigen::MatrixXd B_c = Eigen::MatrixXd::Zero(12, 6);
-        B_c.block<6, 6>(6, 0) = Eigen::MatrixXd::Identity(6, 6);
+        Eigen::MatrixXd B_c = Eigen::MatrixXd::Zero(2 * nq, nq);
+        B_c.block(nq, 0, nq, nq) = Eigen::MatrixXd::Identity(nq, nq);
 
         std::vector<double> x_std(x.data(), x.data() + x.size());
 
@@ -51,9 +90,15 @@ Eigen::VectorXd MotionPlanningProb::discretized_dynamics(double dt, Eigen::Vecto
 }
 
 casadi::MX MotionPlanningProb::forward_kinematics(casadi::MX q)
+{
+    return joint_transforms(q).back();
+}
+
+std::vector<casadi::MX> MotionPlanningProb::joint_transforms(casadi::MX q)
 {
     using namespace casadi;
     MX T = MX::eye(4);
+    std::vector<MX> transforms;
 
     // DH parameters
     std::vector<double> d = {0.2363, 0, 0, 0.2010, 0.1593, 0.1543};
@@ -79,20 +124,98 @@ casadi::MX MotionPlanningProb::forward_kinematics(casadi::MX q)
         A(3, 3) = 1;
 
         T = mtimes(T, A);
+        transforms.push_back(T);
+    }
+
+    return transforms;
+}
+
+casadi::MX MotionPlanningProb::link_points(casadi::MX q)
+{
+    using namespace casadi;
+    auto transforms = joint_transforms(q);
+
+    // frame origins plus the midpoints of the long upper arm and forearm
+    std::vector<MX> points;
+    MX prev = MX::zeros(3, 1);
+    for (size_t i = 0; i < transforms.size(); i++)
+    {
+        MX origin = transforms[i](Slice(0, 3), 3);
+        if (i == 1 || i == 2)
+        {
+            points.push_back((prev + origin) / 2);
+        }
+        points.push_back(origin);
+        prev = origin;
+    }
+    return MX::horzcat(points);
+}
+
+void MotionPlanningProb::add_sphere_obstacle(const Eigen::Vector3d &center, double radius)
+{
+    obstacles.push_back({center, radius});
+}
+
+casadi::MX MotionPlanningProb::collision_distances(casadi::MX q)
+{
+    using namespace casadi;
+    MX points = link_points(q);
+
+    // (r_obstacle + r_link) - distance <= 0 for every pair
+    std::vector<MX> g;
+    for (auto &obstacle : obstacles)
+    {
+        DM center = DM(std::vector<double>(obstacle.first.data(), obstacle.first.data() + 3));
+        for (casadi_int k = 0; k < points.size2(); k++)
+        {
+            MX diff = points(Slice(), k) - center;
+            g.push_back(obstacle.second + link_radius - sqrt(dot(diff, diff) + 1e-9));
+        }
     }
+    return MX::vertcat(g);
+}
+
+void MotionPlanningProb::add_collision_constraints(double rho)
+{
+    if (obstacles.empty())
+    {
+        return;
+    }
+    auto constraint = [this](casadi::MX x, casadi::MX u) { return collision_distances(x(casadi::Slice(0, nu()))); };
+    if (rho > 0)
+    {
+        add_aggregated_constraint(constraint, rho);
+    }
+    else
+    {
+        add_constraint(ConstraintType::Inequality, constraint);
+    }
+}
+
+casadi::MX MotionPlanningProb::singularity_measures(casadi::MX q)
+{
+    using namespace casadi;
+    // det(J) = a2 a3 s3 s5 (a2 c2 + a3 c23 + d5 s234) for the UR DH parameters of forward_kinematics()
+    const double a2 = -0.8620, a3 = -0.7287, d5 = 0.1593;
+
+    MX elbow = sin(q(2));
+    MX wrist = sin(q(4));
+    MX shoulder =
+        (a2 * cos(q(1)) + a3 * cos(q(1) + q(2)) + d5 * sin(q(1) + q(2) + q(3))) / (std::abs(a2) + std::abs(a3));
 
-    return T;
+    return MX::vertcat({elbow, wrist, shoulder});
 }
 
 casadi::MX MotionPlanningProb::compute_trans_error(casadi::MX x_pose)
 {
-    return x_pose - x_pose_ref;
+    return x_pose - x_pose_ref();
 }
 
 casadi::MX MotionPlanningProb::compute_ori_error(casadi::MX x_quat)
 {
     using namespace casadi;
-    MX x_quat_ref_inv = MX::vertcat({x_quat_ref(0), -x_quat_ref(1), -x_quat_ref(2), -x_quat_ref(3)});
+    MX q_ref = x_quat_ref();
+    MX x_quat_ref_inv = MX::vertcat({q_ref(0), -q_ref(1), -q_ref(2), -q_ref(3)});
 
     MX e_ori_temp = MX::vertcat({x_quat(0) * x_quat_ref_inv(0) - x_quat(1) * x_quat_ref_inv(1) -
                                      x_quat(2) * x_quat_ref_inv(2) - x_quat(3) * x_quat_ref_inv(3),
@@ -105,16 +228,11 @@ casadi::MX MotionPlanningProb::compute_ori_error(casadi::MX x_quat)
     return e_ori_temp(Slice(1, 4));
 }
 
-casadi::MX MotionPlanningProb::stage_cost(casadi::MX x, casadi::MX u)
+casadi::MX MotionPlanningProb::end_effector_pose(casadi::MX q)
 {
     using namespace casadi;
-    MX L = 0;
-
-    auto q = x(Slice(0, 6));
     auto T = forward_kinematics(q);
 
-    x_pose = T(Slice(0, 3), 3);
-
     MX Rot = T(Slice(0, 3), Slice(0, 3));
     MX trace = Rot(0, 0) + Rot(1, 1) + Rot(2, 2);
     MX q0 = MX::sqrt(trace + 1) / 2;
@@ -122,19 +240,39 @@ casadi::MX MotionPlanningProb::stage_cost(casadi::MX x, casadi::MX u)
     MX q2 = (Rot(0, 2) - Rot(2, 0)) / (4 * q0);
     MX q3 = (Rot(1, 0) - Rot(0, 1)) / (4 * q0);
 
-    MX x_quat = MX::vertcat({q0, q1, q2, q3});
+    return MX::vertcat({T(Slice(0, 3), 3), q0, q1, q2, q3});
+}
+
+casadi::MX MotionPlanningProb::stage_cost(casadi::MX x, casadi::MX u)
+{
+    using namespace casadi;
+    MX L = 0;
+
+    auto q = x(Slice(0, nu()));
+    MX pose = end_effector_pose(q);
+
+    x_pose = pose(Slice(0, 3));
+    MX x_quat = pose(Slice(3, 7));
 
     auto e_ori = compute_ori_error(x_quat);
 
     auto e_trans = compute_trans_error(x_pose);
 
-    auto q_dot = x(Slice(6, 12));
+    auto q_dot = x(Slice(nu(), nx()));
 
     L += 0.5 * mtimes(e_trans.T(), mtimes(Q_trans, e_trans));
     L += 0.5 * mtimes(e_ori.T(), mtimes(Q_ori, e_ori));
     L += 0.5 * mtimes(q_dot.T(), mtimes(Q_vel, q_dot));
     L += 0.5 * mtimes(u.T(), mtimes(R, u));
 
+    if (w_elbow > 0 || w_wrist > 0 || w_shoulder > 0)
+    {
+        MX m = singularity_measures(q);
+        L += w_elbow / (m(0) * m(0) + singularity_eps);
+        L += w_wrist / (m(1) * m(1) + singularity_eps);
+        L += w_shoulder / (m(2) * m(2) + singularity_eps);
+    }
+
     return dt() * L;
 }
 
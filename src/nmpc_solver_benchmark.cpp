@@ -0,0 +1,71 @@
+// Closed-loop comparison of the MPC solver backends on the headless simulator: IPOPT, and sqpmethod with qpOASES,
+// HPIPM and OSQP, each run to convergence and as real-time iteration (one QP per tick). The same tasks are solved with
+// the fixed UR20 (12 states) and with the UR20 on a planar base (MobileManipulatorProb, 18 states), for the extra solve
+// time of the base.
+//
+// usage: rosrun nmpc_motion_planner nmpc_solver_benchmark [steps] [horizon] [ur20|mobile|all]
+
+#include <nmpc_motion_planner/headless_sim.hpp>
+#include <nmpc_motion_planner/mobile_manipulator_prob.hpp>
+
+#include <iostream>
+
+using namespace casadi_mpc_template;
+
+int main(int argc, char **argv)
+{
+    size_t steps = argc > 1 ? std::stoul(argv[1]) : 300;
+    size_t horizon = argc > 2 ? std::stoul(argv[2]) : 10;
+    std::string model = argc > 3 ? argv[3] : "all";
+    const double dt = 0.01;
+
+    std::vector<std::pair<std::string, std::shared_ptr<MotionPlanningProb>>> models;
+    if (model == "ur20" || model == "all")
+    {
+        models.push_back(
+            {"ur20", std::make_shared<MotionPlanningProb>(Problem::DynamicsType::ContinuesRK4, 12, 6, horizon, dt)});
+    }
+    if (model == "mobile" || model == "all")
+    {
+        models.push_back(
+            {"mobile", std::make_shared<MobileManipulatorProb>(Problem::DynamicsType::ContinuesRK4, horizon, dt)});
+    }
+    if (models.empty())
+    {
+        std::cerr << "unknown model " << model << ", expected ur20, mobile or all" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, casadi::Dict>> sqp_backends = {{"qpoases", MPC::default_qpoases_config()},
+                                                                      {"hpipm", MPC::default_hpipm_config()},
+                                                                      {"osqp", MPC::default_osqp_config()}};
+
+    for (auto &m : models)
+    {
+        auto prob = m.second;
+        prob->set_ur20_bounds();
+        HeadlessSimulator sim(prob);
+        auto scenarios = sim.default_scenarios(steps);
+
+        auto report = [&](const std::string &name, std::string solver_name, casadi::Dict config) {
+            for (auto &scenario : scenarios)
+            {
+                // fresh solver per scenario, so every run starts cold
+                MPC mpc(prob, solver_name, config);
+                mpc.set_shift_warm_start(true);
+                SimResult result = sim.run(mpc, scenario);
+                std::cout << m.first << " / " << name << " / " << scenario.name << ": " << result.stats.summary()
+                          << " | mean " << result.stats.mean_time() << " | final error "
+                          << result.final_position_error << std::endl;
+            }
+        };
+
+        report("ipopt", "ipopt", MPC::default_config());
+        for (auto &backend : sqp_backends)
+        {
+            report("sqp-" + backend.first, "sqpmethod", backend.second);
+            report("rti-" + backend.first, "sqpmethod", MPC::rti_config(backend.second));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,322 @@
+#include <nmpc_motion_planner/problem_spec.hpp>
+
+#include <filesystem>
+#include <iomanip>
+#include <map>
+
+using namespace casadi_mpc_template;
+
+namespace
+{
+
+std::vector<double> parse_list(const std::string &key, const std::string &value)
+{
+    if (value.size() < 2 || value.front() != '[' || value.back() != ']')
+    {
+        throw std::runtime_error("problem spec: " + key + " must be a list [a, b, ...]");
+    }
+    std::vector<double> list;
+    std::istringstream items(value.substr(1, value.size() - 2));
+    std::string item;
+    while (std::getline(items, item, ','))
+    {
+        if (item.find_first_not_of(" \t") != std::string::npos)
+        {
+            list.push_back(std::stod(item));
+        }
+    }
+    return list;
+}
+
+Eigen::VectorXd parse_vector(const std::string &key, const std::string &value, size_t size)
+{
+    std::vector<double> list = parse_list(key, value);
+    if (list.size() != size)
+    {
+        throw std::runtime_error("problem spec: " + key + " needs " + std::to_string(size) + " values");
+    }
+    return Eigen::Map<Eigen::VectorXd>(list.data(), list.size());
+}
+
+bool parse_bool(const std::string &key, const std::string &value)
+{
+    if (value != "true" && value != "false")
+    {
+        throw std::runtime_error("problem spec: " + key + " must be true or false");
+    }
+    return value == "true";
+}
+
+std::string format_list(const double *data, size_t size)
+{
+    std::ostringstream os;
+    os.precision(17);
+    os << "[";
+    for (size_t i = 0; i < size; i++)
+    {
+        os << (i ? ", " : "") << data[i];
+    }
+    os << "]";
+    return os.str();
+}
+
+const std::map<std::string, Problem::DynamicsType> integrators = {
+    {"euler", Problem::DynamicsType::ContinuesForwardEuler},
+    {"modified_euler", Problem::DynamicsType::ContinuesModifiedEuler},
+    {"rk4", Problem::DynamicsType::ContinuesRK4},
+};
+
+ProblemSpec parse_entries(const std::vector<std::pair<std::string, std::string>> &entries, const std::string &path)
+{
+    ProblemSpec spec;
+    const std::string options_prefix = "solver.options.";
+    for (const auto &kv : entries)
+    {
+        const std::string &key = kv.first, &value = kv.second;
+        std::map<std::string, double *> numbers = {
+            {"dt", &spec.dt},
+            {"cost.position", &spec.w_position},
+            {"cost.orientation", &spec.w_orientation},
+            {"cost.velocity", &spec.w_velocity},
+            {"cost.input", &spec.w_input},
+            {"cost.elbow", &spec.w_elbow},
+            {"cost.wrist", &spec.w_wrist},
+            {"cost.shoulder", &spec.w_shoulder},
+            {"cost.singularity_eps", &spec.singularity_eps},
+            {"bounds.acceleration", &spec.accel_limit},
+            {"constraints.link_radius", &spec.link_radius},
+            {"constraints.aggregate_rho", &spec.collision_rho},
+        };
+        std::map<std::string, size_t *> counts = {{"horizon", &spec.horizon},
+                                                  {"condensing_block", &spec.condensing_block},
+                                                  {"input_control_points", &spec.input_control_points}};
+        std::map<std::string, Eigen::VectorXd *> vectors = {{"bounds.position_lower", &spec.position_lower},
+                                                            {"bounds.position_upper", &spec.position_upper},
+                                                            {"bounds.velocity_lower", &spec.velocity_lower},
+                                                            {"bounds.velocity_upper", &spec.velocity_upper}};
+        try
+        {
+            if (numbers.count(key))
+            {
+                *numbers[key] = std::stod(value);
+            }
+            else if (counts.count(key))
+            {
+                *counts[key] = std::stoul(value);
+            }
+            else if (vectors.count(key))
+            {
+                *vectors[key] = parse_vector(key, value, 6);
+            }
+            else if (key == "integrator")
+            {
+                if (!integrators.count(value))
+                {
+                    throw std::runtime_error("problem spec: unknown integrator " + value);
+                }
+                spec.integrator = integrators.at(value);
+            }
+            else if (key == "constraints.obstacles")
+            {
+                spec.obstacles = parse_list(key, value);
+                if (spec.obstacles.size() % 4 != 0)
+                {
+                    throw std::runtime_error("problem spec: obstacles are [x, y, z, radius] per sphere");
+                }
+            }
+            else if (key == "solver.backend")
+            {
+                spec.backend = value;
+            }
+            else if (key == "solver.rti")
+            {
+                spec.rti = parse_bool(key, value);
+            }
+            else if (key.compare(0, options_prefix.size(), options_prefix) == 0)
+            {
+                spec.solver_options[key.substr(options_prefix.size())] = parse_option_value(value);
+            }
+            else
+            {
+                throw std::runtime_error("problem spec: unknown key " + key + " in " + path);
+            }
+        }
+        catch (const std::invalid_argument &)
+        {
+            throw std::runtime_error("problem spec: invalid value of " + key + ": " + value);
+        }
+    }
+    if (spec.horizon == 0 || !(spec.dt > 0))
+    {
+        throw std::runtime_error("problem spec: horizon and dt must be positive");
+    }
+    return spec;
+}
+
+} // namespace
+
+ProblemSpec::ProblemSpec()
+{
+    auto limits = MotionPlanningProb::ur20_joint_limits();
+    position_lower = limits.pos_lower;
+    position_upper = limits.pos_upper;
+    velocity_lower = limits.vel_lower;
+    velocity_upper = limits.vel_upper;
+}
+
+ProblemSpec ProblemSpec::load(const std::string &path)
+{
+    return parse_entries(read_key_values(path, "problem spec"), path);
+}
+
+ProblemSpec ProblemSpec::parse(const std::string &text, const std::string &source)
+{
+    std::istringstream in(text);
+    return parse_entries(read_key_values(in, source, "problem spec"), source);
+}
+
+void ProblemSpec::save(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("problem spec: cannot write " + path);
+    }
+    file << canonical();
+}
+
+std::string ProblemSpec::canonical() const
+{
+    std::map<std::string, std::string> fields;
+    auto number = [](double v) {
+        std::ostringstream os;
+        os.precision(17);
+        os << v;
+        return os.str();
+    };
+    fields["horizon"] = std::to_string(horizon);
+    fields["dt"] = number(dt);
+    for (auto &integrator_name : integrators)
+    {
+        if (integrator_name.second == integrator)
+        {
+            fields["integrator"] = integrator_name.first;
+        }
+    }
+    fields["condensing_block"] = std::to_string(condensing_block);
+    fields["input_control_points"] = std::to_string(input_control_points);
+    fields["cost.position"] = number(w_position);
+    fields["cost.orientation"] = number(w_orientation);
+    fields["cost.velocity"] = number(w_velocity);
+    fields["cost.input"] = number(w_input);
+    fields["cost.elbow"] = number(w_elbow);
+    fields["cost.wrist"] = number(w_wrist);
+    fields["cost.shoulder"] = number(w_shoulder);
+    fields["cost.singularity_eps"] = number(singularity_eps);
+    fields["bounds.position_lower"] = format_list(position_lower.data(), position_lower.size());
+    fields["bounds.position_upper"] = format_list(position_upper.data(), position_upper.size());
+    fields["bounds.velocity_lower"] = format_list(velocity_lower.data(), velocity_lower.size());
+    fields["bounds.velocity_upper"] = format_list(velocity_upper.data(), velocity_upper.size());
+    fields["bounds.acceleration"] = number(accel_limit);
+    fields["constraints.obstacles"] = format_list(obstacles.data(), obstacles.size());
+    fields["constraints.link_radius"] = number(link_radius);
+    fields["constraints.aggregate_rho"] = number(collision_rho);
+    fields["solver.backend"] = backend;
+    fields["solver.rti"] = rti ? "true" : "false";
+    for (const auto &kv : solver_options)
+    {
+        fields["solver.options." + kv.first] = format_option_value(kv.first, kv.second);
+    }
+
+    std::ostringstream os;
+    for (const auto &kv : fields)
+    {
+        os << kv.first << ": " << kv.second << "\n";
+    }
+    return os.str();
+}
+
+std::string ProblemSpec::hash() const
+{
+    uint64_t h = 1469598103934665603ull;
+    for (char c : canonical() + casadi::CasadiMeta::version())
+    {
+        h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    std::ostringstream os;
+    os << std::hex << std::setw(16) << std::setfill('0') << h;
+    return os.str();
+}
+
+std::shared_ptr<MotionPlanningProb> ProblemSpec::make_problem() const
+{
+    using namespace casadi;
+    auto prob = std::make_shared<MotionPlanningProb>(integrator, 12, 6, horizon, dt);
+    prob->Q_trans = w_position * DM::eye(3);
+    prob->Q_ori = w_orientation * DM::eye(3);
+    prob->Q_vel = w_velocity * DM::eye(6);
+    prob->R = w_input * DM::eye(6);
+    prob->w_elbow = w_elbow;
+    prob->w_wrist = w_wrist;
+    prob->w_shoulder = w_shoulder;
+    prob->singularity_eps = singularity_eps;
+
+    prob->set_input_bound(Eigen::VectorXd::Constant(6, -accel_limit), Eigen::VectorXd::Constant(6, accel_limit));
+    prob->set_state_bound((Eigen::VectorXd(12) << position_lower, velocity_lower).finished(),
+                          (Eigen::VectorXd(12) << position_upper, velocity_upper).finished());
+
+    prob->link_radius = link_radius;
+    for (size_t i = 0; i + 3 < obstacles.size(); i += 4)
+    {
+        prob->add_sphere_obstacle(Eigen::Vector3d(obstacles[i], obstacles[i + 1], obstacles[i + 2]), obstacles[i + 3]);
+    }
+    prob->add_collision_constraints(collision_rho);
+    if (input_control_points > 0)
+    {
+        prob->set_input_bspline(input_control_points);
+    }
+    prob->set_condensing_block(condensing_block);
+    return prob;
+}
+
+SolverProfile ProblemSpec::solver_profile() const
+{
+    SolverProfile profile;
+    if (backend == "ipopt")
+    {
+        profile = {"ipopt", MPC::default_config()};
+    }
+    else if (backend == "qpoases")
+    {
+        profile = {"sqpmethod", MPC::default_qpoases_config()};
+    }
+    else if (backend == "hpipm")
+    {
+        profile = {"sqpmethod", MPC::default_hpipm_config()};
+    }
+    else if (backend == "osqp")
+    {
+        profile = {"sqpmethod", MPC::default_osqp_config()};
+    }
+    else
+    {
+        throw std::runtime_error("problem spec: unknown solver backend " + backend);
+    }
+    if (rti && profile.solver == "sqpmethod")
+    {
+        profile.options = MPC::rti_config(profile.options);
+    }
+    casadi::Dict flat = flatten_options(profile.options);
+    for (const auto &kv : solver_options)
+    {
+        flat[kv.first] = kv.second;
+    }
+    profile.options = nest_options(flat);
+    return profile;
+}
+
+std::string ProblemSpec::solver_cache_file(const std::string &directory) const
+{
+    std::filesystem::create_directories(directory);
+    return (std::filesystem::path(directory) / ("nmpc_solver_" + hash() + ".casadi")).string();
+}
@@ -0,0 +1,103 @@
+#include <nmpc_motion_planner/shadow_solver.hpp>
+#include <nmpc_motion_planner/thread_utils.hpp>
+
+#include <chrono>
+
+using namespace casadi_mpc_template;
+
+ShadowSolver::ShadowSolver(std::unique_ptr<MPC> candidate, const std::string &log_file, int cpu)
+    : candidate_(std::move(candidate)), log_(log_file)
+{
+    if (!log_)
+    {
+        throw std::runtime_error("shadow solver: cannot write " + log_file);
+    }
+    log_.precision(9);
+    log_ << "stamp,production_time,production_iterations,candidate_time,candidate_iterations,candidate_status,"
+            "input_diff_max,input_diff_norm\n";
+
+    thread_ = std::thread(&ShadowSolver::worker, this);
+    set_thread_affinity(thread_, cpu);
+}
+
+ShadowSolver::~ShadowSolver()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+void ShadowSolver::submit(const Sample &sample)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (has_sample_)
+        {
+            dropped_++;
+        }
+        sample_ = sample;
+        has_sample_ = true;
+    }
+    cv_.notify_one();
+}
+
+size_t ShadowSolver::dropped() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return dropped_;
+}
+
+std::string ShadowSolver::summary() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    double mean_diff = evaluated_ > 0 ? sum_input_diff_ / evaluated_ : 0.0;
+    return "production: " + production_stats_.summary() + "\ncandidate: " + candidate_stats_.summary() +
+           "\ninput difference mean " + std::to_string(mean_diff) + " max " + std::to_string(max_input_diff_) + ", " +
+           std::to_string(evaluated_) + " ticks evaluated, " + std::to_string(dropped_) + " dropped";
+}
+
+void ShadowSolver::worker()
+{
+    while (true)
+    {
+        Sample sample;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_.wait(lock, [this] { return has_sample_ || stop_; });
+            if (stop_)
+            {
+                return;
+            }
+            sample = sample_;
+            has_sample_ = false;
+        }
+
+        auto t_start = std::chrono::steady_clock::now();
+        Eigen::VectorXd u = candidate_->solve(sample.x0, sample.p);
+        double solve_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+        int iterations = candidate_->iterations();
+
+        double diff_max = std::numeric_limits<double>::quiet_NaN(), diff_norm = diff_max;
+        if (u.size() == sample.u.size())
+        {
+            diff_max = (u - sample.u).cwiseAbs().maxCoeff();
+            diff_norm = (u - sample.u).norm();
+        }
+
+        log_ << sample.stamp << "," << sample.solve_time << "," << sample.iterations << "," << solve_time << ","
+             << iterations << "," << to_string(candidate_->status()) << "," << diff_max << "," << diff_norm << "\n";
+
+        std::lock_guard<std::mutex> lock(mtx_);
+        production_stats_.add(sample.solve_time, sample.iterations);
+        candidate_stats_.add(solve_time, iterations);
+        if (std::isfinite(diff_max))
+        {
+            max_input_diff_ = std::max(max_input_diff_, diff_max);
+            sum_input_diff_ += diff_max;
+            evaluated_++;
+        }
+    }
+}
@@ -0,0 +1,229 @@
+#include <nmpc_motion_planner/time_optimal_planner.hpp>
+
+using namespace casadi_mpc_template;
+
+TimeOptimalPlanner::TimeOptimalPlanner(std::shared_ptr<MotionPlanningProb> prob, size_t num_stages,
+                                       double max_duration, casadi::Dict config)
+    : prob_(prob), N_(num_stages)
+{
+    using namespace casadi;
+    const size_t nx = prob_->nx();
+    const size_t nu = prob_->nu();
+    const double min_duration = 1e-2;
+
+    MX T = MX::sym("T");
+    MX h = T / N_;
+    std::vector<MX> Xs, Us, w, g;
+
+    auto f = [&](MX x, MX u) { return prob_->dynamics(x, u); };
+
+    // time-scaled RK4 step
+    auto step = [&](MX x, MX u) {
+        MX k1 = f(x, u);
+        MX k2 = f(x + h / 2 * k1, u);
+        MX k3 = f(x + h / 2 * k2, u);
+        MX k4 = f(x + h * k3, u);
+        return x + h / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
+    };
+
+    w.push_back(T);
+    lbw_.push_back(min_duration);
+    ubw_.push_back(max_duration);
+
+    const auto &x_bound = prob_->state_bound(0);
+    const auto &u_bound = prob_->input_bound(0);
+
+    for (size_t i = 0; i <= N_; i++)
+    {
+        Xs.push_back(MX::sym("X_" + std::to_string(i), nx, 1));
+        w.push_back(Xs[i]);
+        for (size_t l = 0; l < nx; l++)
+        {
+            // X_0 is pinned to x0 in plan(), the final velocity to zero
+            bool rest = i == N_ && l >= nx / 2;
+            lbw_.push_back(rest ? 0 : x_bound.first[l]);
+            ubw_.push_back(rest ? 0 : x_bound.second[l]);
+        }
+        if (i == N_)
+        {
+            break;
+        }
+        Us.push_back(MX::sym("U_" + std::to_string(i), nu, 1));
+        w.push_back(Us[i]);
+        for (size_t l = 0; l < nu; l++)
+        {
+            lbw_.push_back(u_bound.first[l]);
+            ubw_.push_back(u_bound.second[l]);
+        }
+    }
+
+    MX J = T;
+    for (size_t i = 0; i < N_; i++)
+    {
+        g.push_back(step(Xs[i], Us[i]) - Xs[i + 1]);
+        lbg_.insert(lbg_.end(), nx, 0.0);
+        ubg_.insert(ubg_.end(), nx, 0.0);
+        J += 1e-4 * h * dot(Us[i], Us[i]);
+    }
+
+    // reach the target pose
+    MX q_N = Xs[N_](Slice(0, nx / 2));
+    MX pose = prob_->end_effector_pose(q_N);
+    g.push_back(prob_->compute_trans_error(pose(Slice(0, 3))));
+    g.push_back(prob_->compute_ori_error(pose(Slice(3, 7))));
+    lbg_.insert(lbg_.end(), 6, 0.0);
+    ubg_.insert(ubg_.end(), 6, 0.0);
+
+    MXDict nlp = {{"x", vertcat(w)}, {"f", J}, {"g", vertcat(g)}, {"p", prob_->parameter()}};
+    solver_ = nlpsol("time_optimal_solver", "ipopt", nlp, config);
+
+    MX q = MX::sym("q", nx / 2);
+    pose_fn_ = Function("end_effector_pose", {q}, {prob_->end_effector_pose(q)});
+
+    thread_ = std::thread(&TimeOptimalPlanner::worker, this);
+}
+
+TimeOptimalPlanner::~TimeOptimalPlanner()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+std::shared_ptr<const TimeOptimalPlanner::Trajectory> TimeOptimalPlanner::plan(const Eigen::VectorXd &x0,
+                                                                               const Eigen::VectorXd &p)
+{
+    using namespace casadi;
+    const size_t nx = prob_->nx();
+    const size_t nu = prob_->nu();
+
+    std::vector<double> lbw = lbw_, ubw = ubw_;
+    std::copy(x0.data(), x0.data() + nx, lbw.begin() + 1);
+    std::copy(x0.data(), x0.data() + nx, ubw.begin() + 1);
+
+    // initial guess: stand still at x0 for half the maximal duration
+    std::vector<double> w0;
+    w0.push_back(0.5 * ubw_[0]);
+    for (size_t i = 0; i <= N_; i++)
+    {
+        w0.insert(w0.end(), x0.data(), x0.data() + nx);
+        if (i < N_)
+        {
+            w0.insert(w0.end(), nu, 0.0);
+        }
+    }
+
+    DMDict arg = {{"x0", w0},   {"lbx", lbw}, {"ubx", ubw},
+                  {"lbg", lbg_}, {"ubg", ubg_}, {"p", std::vector<double>(p.data(), p.data() + p.size())}};
+    DMDict sol = solver_(arg);
+    if (!solver_.stats()["success"].as_bool())
+    {
+        return nullptr;
+    }
+
+    std::vector<double> w = sol["x"].nonzeros();
+    auto traj = std::make_shared<Trajectory>();
+    traj->duration = w[0];
+    size_t offset = 1;
+    for (size_t i = 0; i <= N_; i++)
+    {
+        Eigen::VectorXd x = Eigen::Map<Eigen::VectorXd>(w.data() + offset, nx);
+        offset += nx + nu;
+
+        std::vector<double> pose = pose_fn_(DM(std::vector<double>(x.data(), x.data() + nx / 2)))[0].nonzeros();
+        traj->time.push_back(traj->duration * i / N_);
+        traj->states.push_back(x);
+        traj->poses.push_back(Eigen::Map<Eigen::VectorXd>(pose.data(), pose.size()));
+    }
+    return traj;
+}
+
+size_t TimeOptimalPlanner::request(const Eigen::VectorXd &x0, const Eigen::VectorXd &p)
+{
+    size_t id;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        req_x0_ = x0;
+        req_p_ = p;
+        has_request_ = true;
+        id = ++request_id_;
+    }
+    cv_.notify_one();
+    return id;
+}
+
+std::shared_ptr<const TimeOptimalPlanner::Trajectory> TimeOptimalPlanner::latest() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return latest_;
+}
+
+size_t TimeOptimalPlanner::latest_id() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return latest_id_;
+}
+
+void TimeOptimalPlanner::worker()
+{
+    while (true)
+    {
+        Eigen::VectorXd x0, p;
+        size_t id;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_.wait(lock, [this] { return has_request_ || stop_; });
+            if (stop_)
+            {
+                return;
+            }
+            x0 = req_x0_;
+            p = req_p_;
+            id = request_id_;
+            has_request_ = false;
+        }
+
+        auto traj = plan(x0, p);
+
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (traj)
+        {
+            latest_ = traj;
+            latest_id_ = id;
+        }
+    }
+}
+
+Eigen::VectorXd TimeOptimalPlanner::Trajectory::reference_parameter(double t) const
+{
+    if (t >= duration)
+    {
+        return poses.back();
+    }
+    t = std::max(t, 0.0);
+    size_t i = std::min<size_t>(t / duration * (time.size() - 1), time.size() - 2);
+    double s = (t - time[i]) / (time[i + 1] - time[i]);
+
+    Eigen::VectorXd p(7);
+    p.head(3) = (1 - s) * poses[i].head(3) + s * poses[i + 1].head(3);
+    Eigen::Quaterniond q0(poses[i][3], poses[i][4], poses[i][5], poses[i][6]);
+    Eigen::Quaterniond q1(poses[i + 1][3], poses[i + 1][4], poses[i + 1][5], poses[i + 1][6]);
+    Eigen::Quaterniond q = q0.slerp(s, q1);
+    p.tail(4) << q.w(), q.x(), q.y(), q.z();
+    return p;
+}
+
+Eigen::VectorXd TimeOptimalPlanner::Trajectory::state(double t) const
+{
+    if (t >= duration)
+    {
+        return states.back();
+    }
+    t = std::max(t, 0.0);
+    size_t i = std::min<size_t>(t / duration * (time.size() - 1), time.size() - 2);
+    double s = (t - time[i]) / (time[i + 1] - time[i]);
+    return (1 - s) * states[i] + s * states[i + 1];
+}